@@ -6,9 +6,12 @@
 #include "llvm/Constants.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Support/CommandLine.h"
 
 #include <ostream>
 
+#include "trace.h"
+
 using namespace llvm;
 
 APFloat::roundingMode rMode = APFloat::rmNearestTiesToEven;
@@ -30,6 +33,9 @@ namespace
   template<>
     bool valEquals (ConstantFP *L, APFloat *R) {return L->getValueAPF().compare(*R) == APFloat::cmpEqual;}
 
+  static cl::opt<std::string> LocalOptsTrace("localopts-trace",
+      cl::desc("Write a timeline of -LocalOpts block sweeps to this file at exit, in trace event JSON"));
+
   struct LocalOpts : public FunctionPass
   {
     static char ID;
@@ -453,8 +459,11 @@ namespace
       optinf.constProp = 0;
       optinf.algebraic = 0;
       optinf.strengthRed = 0;
+      if (!LocalOptsTrace.empty()) startTrace(LocalOptsTrace);
       for (Function::iterator bb = f.begin(); bb != f.end(); bb++) {
+        traceBegin("runOnBasicBlock", f);
         modified = runOnBasicBlock(*bb, optinf);
+        traceEnd("runOnBasicBlock", f);
       }
       errs() << "Optimizations performed:\n";
       errs() << "Constant Propagation: " << optinf.constProp << "\n";
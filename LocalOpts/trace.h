@@ -0,0 +1,57 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+#ifndef DATAFLOW_TRACE_H
+#define DATAFLOW_TRACE_H
+
+#include "llvm/Function.h"
+
+#include <string>
+
+/* Timeline of pass phases in the trace event format that chrome://tracing
+ * and Perfetto load. A pass turns it on with startTrace(file); from then on
+ * traceBegin/traceEnd record one event each into a buffer owned by the
+ * calling thread, so recording takes no lock. Everything is written to the
+ * file when the process exits. The state lives once per plugin, in
+ * trace.cpp, so every pass in it shares one timeline. */
+
+// s as the body of a JSON string
+inline std::string jsonEscape(const std::string &s) {
+  std::string r;
+  for (unsigned i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      r += '\\';
+      r += c;
+    } else if (c < 0x20) {
+      static const char hex[] = "0123456789abcdef";
+      r += "\\u00";
+      r += hex[c >> 4];
+      r += hex[c & 15];
+    } else {
+      r += c;
+    }
+  }
+  return r;
+}
+
+// where the trace goes, NULL while tracing is off
+extern std::string *traceFile;
+
+// turns tracing on, writing to file at exit. Later calls do nothing.
+void startTrace(const std::string &file);
+
+// records phase ('B' or 'E') of the phase `name`, a string literal, of F
+void traceEvent(const char *name, char phase, const llvm::Function &F);
+
+// start and end of phase `name` of F on this thread, if tracing
+inline void traceBegin(const char *name, const llvm::Function &F) {
+  if (traceFile) traceEvent(name, 'B', F);
+}
+
+inline void traceEnd(const char *name, const llvm::Function &F) {
+  if (traceFile) traceEvent(name, 'E', F);
+}
+
+#endif
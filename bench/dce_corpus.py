@@ -0,0 +1,183 @@
+#!/usr/bin/env python
+# CMU 15-745: Optimizing Compilers
+# Spring 2011
+# Salil Joshi and Cyrus Omar
+#
+# Runs -DCE and LLVM's -adce over every bitcode (or .ll) file in a directory,
+# the batch version of hw3/build.sh. For each file and pass it records the
+# pass time (the opt run minus an opt run with no passes), the instructions
+# removed and the output's size, runs each output that has a main with lli to
+# check it still prints and returns what the input does, and writes a table.
+#
+#   python bench/dce_corpus.py -lib llvm/Debug+Asserts/lib corpus/ -out dce.csv
+
+import csv
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from argparse import ArgumentParser
+
+PASSES = ['DCE', 'adce']
+
+COLUMNS = ['file', 'pass', 'status', 'insts_before', 'insts_after', 'removed', 'bytes_before', 'bytes_after',
+           'pass_s', 'matches']
+
+
+def call(cmd, timeout=None, stdin=None):
+    """Runs cmd; returns exit status, stdout and wall time. A run that goes
+    over timeout seconds is killed and reports status None."""
+    devnull = open(os.devnull, 'w')
+    # a file rather than a pipe, so a chatty program can't block on it
+    out = tempfile.TemporaryFile()
+    start = time.time()
+    p = subprocess.Popen(cmd, stdout=out, stderr=devnull, stdin=stdin)
+    # Popen has no timeout in Python 2, so poll
+    while p.poll() is None and (timeout is None or time.time() - start < timeout):
+        time.sleep(0.001)
+    elapsed = time.time() - start
+    devnull.close()
+    if p.poll() is None:
+        p.kill()
+        p.wait()
+        out.close()
+        return None, b'', elapsed
+    out.seek(0)
+    text = out.read()
+    out.close()
+    return p.returncode, text, elapsed
+
+
+def countInstructions(text):
+    """Instructions in the function bodies of a disassembled module."""
+    n = 0
+    inside = False
+    for line in text.decode('utf-8', 'replace').split('\n'):
+        if line.startswith('define '):
+            inside = True
+        elif line.startswith('}'):
+            inside = False
+        elif inside and line.startswith('  ') and not line.lstrip().startswith(';'):
+            n += 1
+    return n
+
+
+def fastest(o, cmd):
+    best = None
+    for r in range(o.repeat):
+        status, out, t = call(cmd)
+        if status != 0:
+            return status, None
+        best = t if best is None else min(best, t)
+    return 0, best
+
+
+def execute(o, module):
+    """What running module with lli gives: (exit status, stdout), or None
+    when it has no main."""
+    status, text, t = call([o.dis, module, '-o', '-'])
+    if not re.search(r'^define .*@main\(', text.decode('utf-8', 'replace'), re.M):
+        return None
+    devnull = open(os.devnull)
+    status, out, t = call([o.lli, module] + o.args.split(), o.timeout, devnull)
+    devnull.close()
+    return status, out
+
+
+def compare(o, path, tmp, out):
+    name = os.path.basename(path)
+    # the input through opt with no passes: bitcode even if it was a .ll,
+    # and the time that opt takes besides the pass
+    base = os.path.join(tmp, 'base.bc')
+    status, baseTime = fastest(o, [o.opt, path, '-o', base])
+    if status != 0:
+        sys.stderr.write('%s: opt fails with no passes\n' % name)
+        return
+    status, text, t = call([o.dis, base, '-o', '-'])
+    before = countInstructions(text)
+    expected = execute(o, base) if o.lli else None
+
+    for p in PASSES:
+        result = os.path.join(tmp, '%s.bc' % p)
+        if p == 'DCE':
+            cmd = [o.opt, '-load', os.path.join(o.lib, 'DCE.so'), '-DCE', path, '-o', result]
+        else:
+            cmd = [o.opt, '-adce', path, '-o', result]
+        row = {'file': name, 'pass': p, 'insts_before': before, 'bytes_before': os.path.getsize(base)}
+        status, t = fastest(o, cmd)
+        if status != 0:
+            row['status'] = 'crash' if status < 0 else 'error %d' % status
+            out.append(row)
+            continue
+
+        status, text, ignored = call([o.dis, result, '-o', '-'])
+        row['status'] = 'ok'
+        row['insts_after'] = countInstructions(text)
+        row['removed'] = before - row['insts_after']
+        row['bytes_after'] = os.path.getsize(result)
+        row['pass_s'] = '%.4f' % max(t - baseTime, 0)
+        if expected is None:
+            row['matches'] = '-'
+        else:
+            row['matches'] = 'yes' if execute(o, result) == expected else 'NO'
+        out.append(row)
+
+
+def summarize(rows):
+    sys.stdout.write('%-24s %-5s %-8s %8s %8s %8s %9s %8s\n'
+                     % ('file', 'pass', 'status', 'before', 'after', 'removed', 'pass s', 'matches'))
+    for r in rows:
+        sys.stdout.write('%-24s %-5s %-8s %8s %8s %8s %9s %8s\n'
+                         % (r['file'][:24], r['pass'], r['status'], r['insts_before'], r.get('insts_after', ''),
+                            r.get('removed', ''), r.get('pass_s', ''), r.get('matches', '')))
+    sys.stdout.write('\n')
+    for p in PASSES:
+        ok = [r for r in rows if r['pass'] == p and r['status'] == 'ok']
+        failed = len([r for r in rows if r['pass'] == p]) - len(ok)
+        before = sum(r['insts_before'] for r in ok)
+        removed = sum(r['removed'] for r in ok)
+        seconds = sum(float(r['pass_s']) for r in ok)
+        wrong = len([r for r in ok if r['matches'] == 'NO'])
+        sys.stdout.write('%-5s %d files, %d failed, %d of %d instructions removed (%.1f%%), %.3f s, %d wrong outputs\n'
+                         % (p, len(ok), failed, removed, before, 100.0 * removed / max(before, 1), seconds, wrong))
+
+
+def options(args):
+    p = ArgumentParser(description='Compares -DCE with -adce over a directory of modules.')
+    p.add_argument('corpus', help='directory of .bc or .ll files')
+    p.add_argument('-opt', default='opt')
+    p.add_argument('-dis', default='llvm-dis')
+    p.add_argument('-lli', default='lli', help='the lli to check outputs with, empty to skip the check')
+    p.add_argument('-lib', default='llvm/Debug+Asserts/lib', help='directory with DCE.so')
+    p.add_argument('-args', default='', help='arguments for each program\'s main')
+    p.add_argument('-timeout', type=float, default=10, help='seconds a program may run under lli')
+    p.add_argument('-repeat', type=int, default=3, help='runs per timing, the fastest is kept')
+    p.add_argument('-out', default='dce.csv', help='CSV file for the per-file rows')
+    return p.parse_args(args)
+
+
+def main():
+    o = options(sys.argv[1:])
+    files = sorted(f for f in os.listdir(o.corpus) if f.endswith('.bc') or f.endswith('.ll'))
+    rows = []
+    tmp = tempfile.mkdtemp()
+    try:
+        for f in files:
+            compare(o, os.path.join(o.corpus, f), tmp, rows)
+    finally:
+        shutil.rmtree(tmp)
+
+    results = open(o.out, 'w')
+    out = csv.DictWriter(results, COLUMNS)
+    out.writeheader()
+    for r in rows:
+        out.writerow(r)
+    results.close()
+    summarize(rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,203 @@
+#!/usr/bin/env python
+# CMU 15-745: Optimizing Compilers
+# Spring 2011
+# Salil Joshi and Cyrus Omar
+#
+# Writes an LLVM 2.8 .ll module of functions with a controlled CFG shape, for
+# timing the dataflow passes on something bigger than sum.cpp. The same
+# arguments always give the same module.
+#
+#   python gen_cfg.py -blocks 10000 -depth 3 -irreducible 0.05 -fanout 8 > big.ll
+
+import random
+import sys
+from argparse import ArgumentParser
+
+
+class Rng:
+    """random.Random's integer helpers changed between Python 2 and 3; these
+    only use random(), so a seed gives the same module under either."""
+    def __init__(self, seed):
+        self.r = random.Random(seed)
+
+    def random(self):
+        return self.r.random()
+
+    def randrange(self, n):
+        return int(self.r.random() * n)
+
+    def randint(self, lo, hi):
+        return lo + self.randrange(hi - lo + 1)
+
+    def choice(self, seq):
+        return seq[self.randrange(len(seq))]
+
+
+class Function:
+    def __init__(self, name, opts, rng):
+        self.name = name
+        self.opts = opts
+        self.rng = rng
+        self.blocks = []
+        self.temps = 0
+
+    def block(self):
+        b = {'name': 'b%d' % len(self.blocks), 'insts': [], 'term': None}
+        self.blocks.append(b)
+        return b
+
+    def temp(self):
+        self.temps += 1
+        return '%%t%d' % self.temps
+
+    def fill(self, b):
+        # straight-line code: loads of stack variables, arithmetic on them
+        # and on the values defined in entry, stores back
+        r = self.rng
+        local = []
+        for i in range(r.randint(1, 2 * self.opts.insts - 1)):
+            c = r.random()
+            if c < 0.3 or not local:
+                t = self.temp()
+                b['insts'].append('%s = load i32* %%v%d' % (t, r.randrange(self.opts.vars)))
+                local.append(t)
+            elif c < 0.8:
+                t = self.temp()
+                x = r.choice(local)
+                if self.opts.values and r.random() < 0.5:
+                    y = '%%e%d' % r.randrange(self.opts.values)
+                else:
+                    y = r.choice(local)
+                op = r.choice(['add', 'sub', 'mul', 'xor', 'and', 'or'])
+                b['insts'].append('%s = %s i32 %s, %s' % (t, op, x, y))
+                local.append(t)
+            else:
+                b['insts'].append('store i32 %s, i32* %%v%d' % (r.choice(local), r.randrange(self.opts.vars)))
+        return local[-1]
+
+    def branch(self, b, yes, no):
+        v = self.fill(b)
+        c = self.temp()
+        b['insts'].append('%s = icmp slt i32 %s, 0' % (c, v))
+        b['term'] = 'br i1 %s, label %%%s, label %%%s' % (c, yes['name'], no['name'])
+
+    def jump(self, b, to):
+        self.fill(b)
+        b['term'] = 'br label %%%s' % to['name']
+
+    def region(self, cur, budget, depth):
+        """Ends the open block cur with one region of at most budget new
+        blocks and returns the region's open exit block."""
+        r = self.rng
+        o = self.opts
+        kinds = ['straight', 'diamond']
+        if budget >= o.fanout + 1 and o.fanout > 2:
+            kinds.append('switch')
+        if depth < o.depth and budget >= 3:
+            kinds += ['loop', 'loop']
+        kind = r.choice(kinds)
+        if budget >= 3 and r.random() < o.irreducible:
+            kind = 'irreducible'
+
+        if kind == 'straight' or budget < 3:
+            nxt = self.block()
+            self.jump(cur, nxt)
+            return nxt
+        if kind == 'diamond':
+            yes, no = self.block(), self.block()
+            self.branch(cur, yes, no)
+            left = budget - 3
+            yes = self.sequence(yes, r.randint(0, left // 2), depth)
+            no = self.sequence(no, r.randint(0, left // 2), depth)
+            join = self.block()
+            self.jump(yes, join)
+            self.jump(no, join)
+            return join
+        if kind == 'switch':
+            # fan-out of up to -fanout at the top, the same fan-in at the join
+            k = r.randint(3, o.fanout)
+            v = self.fill(cur)
+            arms = [self.block() for i in range(k)]
+            cases = ' '.join('i32 %d, label %%%s' % (i, arms[i]['name']) for i in range(1, k))
+            cur['term'] = 'switch i32 %s, label %%%s [ %s ]' % (v, arms[0]['name'], cases)
+            left = budget - k - 1
+            ends = [self.sequence(a, r.randint(0, left // k), depth) for a in arms]
+            join = self.block()
+            for e in ends:
+                self.jump(e, join)
+            return join
+        if kind == 'loop':
+            head = self.block()
+            self.jump(cur, head)
+            body, out = self.block(), self.block()
+            self.branch(head, body, out)
+            end = self.sequence(body, r.randint(0, budget - 3), depth + 1)
+            self.jump(end, head)
+            return out
+        # two blocks that branch to each other, each entered from cur
+        a, b, out = self.block(), self.block(), self.block()
+        self.branch(cur, a, b)
+        self.branch(a, b, out)
+        self.branch(b, a, out)
+        return out
+
+    def sequence(self, cur, budget, depth):
+        stop = len(self.blocks) + budget
+        while len(self.blocks) < stop:
+            cur = self.region(cur, stop - len(self.blocks), depth)
+        return cur
+
+    def emit(self, out):
+        o = self.opts
+        out.append('define i32 @%s(i32 %%a, i32 %%b) {' % self.name)
+        out.append('entry:')
+        for v in range(o.vars):
+            out.append('  %%v%d = alloca i32' % v)
+        for v in range(o.vars):
+            out.append('  store i32 %s, i32* %%v%d' % ('%a' if v % 2 else '%b', v))
+        for e in range(o.values):
+            out.append('  %%e%d = %s i32 %s, %d' % (e, 'add' if e % 2 else 'xor', '%a' if e % 3 else '%b', e + 1))
+
+        first = self.block()
+        end = self.sequence(first, o.blocks - 1, 0)
+        v = self.fill(end)
+        end['term'] = 'ret i32 %s' % v
+        out.append('  br label %%%s' % first['name'])
+
+        for b in self.blocks:
+            out.append('')
+            out.append('%s:' % b['name'])
+            for i in b['insts']:
+                out.append('  ' + i)
+            out.append('  ' + b['term'])
+        out.append('}')
+        out.append('')
+
+
+def options(args):
+    p = ArgumentParser(description='Writes a module of generated functions to stdout.')
+    p.add_argument('-blocks', type=int, default=1000, help='basic blocks per function, besides entry')
+    p.add_argument('-depth', type=int, default=3, help='deepest loop nesting')
+    p.add_argument('-irreducible', type=float, default=0.0,
+                   help='chance that a region is a two-entry cycle')
+    p.add_argument('-fanout', type=int, default=4, help='most successors of a switch, and so predecessors of its join')
+    p.add_argument('-values', type=int, default=32, help='values defined in entry and used throughout')
+    p.add_argument('-vars', type=int, default=16, help='stack variables (allocas)')
+    p.add_argument('-insts', type=int, default=4, help='average instructions per block')
+    p.add_argument('-functions', type=int, default=1)
+    p.add_argument('-seed', type=int, default=1)
+    o = p.parse_args(args)
+    o.vars = max(o.vars, 1)
+    o.insts = max(o.insts, 1)
+    return o
+
+
+def generate(o):
+    out = []
+    for f in range(o.functions):
+        Function('f%d' % f, o, Rng(o.seed * 7919 + f)).emit(out)
+    return '\n'.join(out)
+
+
+if __name__ == '__main__':
+    sys.stdout.write(generate(options(sys.argv[1:])))
@@ -0,0 +1,43 @@
+; Rewrites for -liveness-check-update to try: in each block, the uses of a
+; value live across blocks go to an earlier value that was only used in its
+; own block. Every point should match a fresh solve.
+;   llvm-as crossing.ll -o crossing.o
+;   opt -load llvm/Debug+Asserts/lib/DataflowFramework.so -Liveness -liveness-check-update crossing.o -o out
+
+define i32 @branch(i32 %a, i32 %b) {
+entry:
+  %t = add i32 %a, %b
+  %u = mul i32 %t, 2
+  %x = sub i32 %a, 1
+  %c = icmp slt i32 %u, %x
+  br i1 %c, label %then, label %done
+
+then:
+  %y = add i32 %x, %u
+  br label %done
+
+done:
+  %r = phi i32 [ %x, %entry ], [ %y, %then ]
+  ret i32 %r
+}
+
+define i32 @loop(i32 %n) {
+entry:
+  br label %head
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %next, %body ]
+  %s = phi i32 [ 0, %entry ], [ %sum, %body ]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+
+body:
+  %k = mul i32 %i, 3
+  %k2 = add i32 %k, 1
+  %sum = add i32 %s, %k2
+  %next = add i32 %i, 1
+  br label %head
+
+exit:
+  ret i32 %s
+}
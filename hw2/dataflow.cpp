@@ -4,6 +4,7 @@
  **/
 
 #include "llvm/Pass.h"
+#include "llvm/Module.h"
 #include "llvm/BasicBlock.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Instruction.h"
@@ -13,66 +14,874 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/ValueMap.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SparseBitVector.h"
 #include "llvm/Support/CFG.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/System/DataTypes.h"
+
+#include "trace.h"
 
 #include <ostream>
-#include <list>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <string>
+#include <fstream>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdlib>
+#include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace llvm;
 
 namespace
 {
-    template<bool forward>
-    struct Dataflow 
+    typedef uint64_t BitWord;
+    enum { BITWORD_SIZE = 64 };
+
+    // what an analysis' meet does, see DataflowSolver::meetOp
+    enum MeetOp { MEET_CUSTOM, MEET_UNION, MEET_INTERSECTION };
+
+#ifdef __AVX2__
+    /* The dense kernels below go four words at a time when built for AVX2
+     * (e.g. with -mavx2 or -march=native), one word at a time otherwise. */
+    enum { VECTOR_WORDS = 4 };
+
+    inline __m256i loadWords(const BitWord *w) { return _mm256_loadu_si256((const __m256i*)w); }
+    inline void storeWords(BitWord *w, __m256i v) { _mm256_storeu_si256((__m256i*)w, v); }
+    inline bool anySet(__m256i v) { return !_mm256_testz_si256(v, v); }
+#endif
+
+    /* dst = the union (or intersection) of the k rows that start at
+     * base + (first + step * idx[i]) * numWords, in one sweep over dst */
+    template<bool intersect>
+    inline void meetWords(BitWord *dst, const BitWord *base, unsigned first, unsigned step,
+                          const unsigned *idx, unsigned k, unsigned numWords) {
+      unsigned w = 0;
+#ifdef __AVX2__
+      for (; w + VECTOR_WORDS <= numWords; w += VECTOR_WORDS) {
+        __m256i acc = loadWords(base + (size_t)(first + step * idx[0]) * numWords + w);
+        for (unsigned i = 1; i < k; i++) {
+          __m256i v = loadWords(base + (size_t)(first + step * idx[i]) * numWords + w);
+          acc = intersect ? _mm256_and_si256(acc, v) : _mm256_or_si256(acc, v);
+        }
+        storeWords(dst + w, acc);
+      }
+#endif
+      for (; w < numWords; w++) {
+        BitWord acc = base[(size_t)(first + step * idx[0]) * numWords + w];
+        for (unsigned i = 1; i < k; i++) {
+          BitWord v = base[(size_t)(first + step * idx[i]) * numWords + w];
+          acc = intersect ? acc & v : acc | v;
+        }
+        dst[w] = acc;
+      }
+    }
+
+    /* Bump allocator for the sets of one function. Nothing is freed on its
+     * own; reset() drops everything at once before the next function. It
+     * keeps one chunk of up to KEEP_BYTES for reuse and returns the rest to
+     * the system, so what a module costs is bounded by its biggest function
+     * while it is analyzed and by KEEP_BYTES after. Chunks and allocations
+     * are cache line aligned. */
+    struct Arena {
+      enum { CHUNK_BYTES = 64 << 10, KEEP_BYTES = 4 << 20, ALIGN = 64 };
+
+      Arena() : used(0), total(0) {}
+      ~Arena() { release(); }
+
+      struct Chunk {
+        char *data;
+        size_t size;
+      };
+
+      // newest last, allocations come from the end of the last one
+      std::vector<Chunk> chunks;
+      size_t used;
+      // bytes in all chunks
+      size_t total;
+
+      void *allocate(size_t bytes) {
+        bytes = (bytes + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+        if (chunks.empty() || used + bytes > chunks.back().size) {
+          grow(std::max(bytes, (size_t)CHUNK_BYTES));
+        }
+        void *p = chunks.back().data + used;
+        used += bytes;
+        return p;
+      }
+
+      // everything allocate() returned is gone
+      void reset() {
+        if (chunks.size() == 1 && total <= KEEP_BYTES) {
+          used = 0;
+          return;
+        }
+        // next time, one chunk holds what this function needed
+        size_t keep = std::min(total, (size_t)KEEP_BYTES);
+        release();
+        if (keep) grow(keep);
+      }
+
+      // and the memory too
+      void release() {
+        for (unsigned i = 0; i < chunks.size(); i++) free(chunks[i].data);
+        chunks.clear();
+        used = 0;
+        total = 0;
+      }
+
+      void grow(size_t size) {
+        Chunk c;
+        void *p = NULL;
+        if (posix_memalign(&p, ALIGN, size) != 0) {
+          errs() << "dataflow: out of memory\n";
+          abort();
+        }
+        c.data = static_cast<char*>(p);
+        c.size = size;
+        chunks.push_back(c);
+        used = 0;
+        total += size;
+      }
+
+    private:
+      // chunks are owned, so an Arena is never copied
+      Arena(const Arena&);
+      void operator=(const Arena&);
+    };
+
+    /* one fixed-width bitvector living inside a DenseMatrix. This is only a view:
+     * copying a DenseRow copies the pointer, use copy() to copy the bits.
+     * Bits past size() in the last word are always kept zero. */
+    struct DenseRow {
+      DenseRow() : words(NULL), numBits(0), numWords(0) {}
+      DenseRow(BitWord *w, unsigned bits, unsigned nwords) : words(w), numBits(bits), numWords(nwords) {}
+
+      BitWord *words;
+      unsigned numBits;
+      unsigned numWords;
+
+      unsigned size() const { return numBits; }
+
+      bool operator[](unsigned i) const {
+        return (words[i / BITWORD_SIZE] >> (i % BITWORD_SIZE)) & 1;
+      }
+
+      void set(unsigned i) { words[i / BITWORD_SIZE] |= BitWord(1) << (i % BITWORD_SIZE); }
+      void reset(unsigned i) { words[i / BITWORD_SIZE] &= ~(BitWord(1) << (i % BITWORD_SIZE)); }
+
+      // set every bit
+      void set() {
+        for (unsigned w = 0; w < numWords; w++) words[w] = ~BitWord(0);
+        clearTail();
+      }
+
+      // clear every bit
+      void reset() {
+        for (unsigned w = 0; w < numWords; w++) words[w] = 0;
+      }
+
+      void copy(const DenseRow &o) {
+        for (unsigned w = 0; w < numWords; w++) words[w] = o.words[w];
+      }
+
+      // copy o, which may be narrower than this row; bits past o.size() are cleared
+      void load(const DenseRow &o) {
+        unsigned w = 0;
+        for (; w < o.numWords && w < numWords; w++) words[w] = o.words[w];
+        for (; w < numWords; w++) words[w] = 0;
+        clearTail();
+      }
+
+      // copy o into this row in the same pass that compares them,
+      // returns true if any bit changed
+      bool assign(const DenseRow &o) {
+        BitWord diff = 0;
+        unsigned w = 0;
+#ifdef __AVX2__
+        __m256i vdiff = _mm256_setzero_si256();
+        for (; w + VECTOR_WORDS <= numWords; w += VECTOR_WORDS) {
+          __m256i v = loadWords(o.words + w);
+          vdiff = _mm256_or_si256(vdiff, _mm256_xor_si256(loadWords(words + w), v));
+          storeWords(words + w, v);
+        }
+        diff = anySet(vdiff);
+#endif
+        for (; w < numWords; w++) {
+          diff |= words[w] ^ o.words[w];
+          words[w] = o.words[w];
+        }
+        return diff != 0;
+      }
+
+      // this = gen | (src & ~kill) in one pass, returns true if any bit changed
+      bool assignGenKill(const DenseRow &gen, const DenseRow &src, const DenseRow &kill) {
+        BitWord diff = 0;
+        unsigned w = 0;
+#ifdef __AVX2__
+        __m256i vdiff = _mm256_setzero_si256();
+        for (; w + VECTOR_WORDS <= numWords; w += VECTOR_WORDS) {
+          // andnot(a, b) is ~a & b
+          __m256i v = _mm256_or_si256(loadWords(gen.words + w),
+                                      _mm256_andnot_si256(loadWords(kill.words + w), loadWords(src.words + w)));
+          vdiff = _mm256_or_si256(vdiff, _mm256_xor_si256(loadWords(words + w), v));
+          storeWords(words + w, v);
+        }
+        diff = anySet(vdiff);
+#endif
+        for (; w < numWords; w++) {
+          BitWord v = gen.words[w] | (src.words[w] & ~kill.words[w]);
+          diff |= words[w] ^ v;
+          words[w] = v;
+        }
+        return diff != 0;
+      }
+
+      DenseRow &operator|=(const DenseRow &o) {
+        for (unsigned w = 0; w < numWords; w++) words[w] |= o.words[w];
+        return *this;
+      }
+
+      DenseRow &operator&=(const DenseRow &o) {
+        for (unsigned w = 0; w < numWords; w++) words[w] &= o.words[w];
+        return *this;
+      }
+
+      bool operator==(const DenseRow &o) const {
+        for (unsigned w = 0; w < numWords; w++)
+          if (words[w] != o.words[w]) return false;
+        return true;
+      }
+
+      bool operator!=(const DenseRow &o) const { return !(*this == o); }
+
+      unsigned count() const {
+        unsigned n = 0;
+        for (unsigned w = 0; w < numWords; w++) n += CountPopulation_64(words[w]);
+        return n;
+      }
+
+      void clearTail() {
+        if (numBits % BITWORD_SIZE)
+          words[numWords - 1] &= (BitWord(1) << (numBits % BITWORD_SIZE)) - 1;
+      }
+    };
+
+    /* a set of equal-width bitvectors stored back to back in one allocation,
+     * one row per entry with a fixed stride in words */
+    struct DenseMatrix {
+      DenseMatrix() : words(NULL), numRows(0), numBits(0), stride(0) {}
+
+      typedef DenseRow Set;
+
+      // owned by the arena given to resize
+      BitWord *words;
+      unsigned numRows;
+      unsigned numBits;
+      unsigned stride;
+
+      /* every row is cleared, in memory from arena. The old rows are left
+       * where they were: they go when the arena is reset. */
+      void resize(unsigned rows, unsigned bits, Arena &arena) {
+        numRows = rows;
+        numBits = bits;
+        stride = (bits + BITWORD_SIZE - 1) / BITWORD_SIZE;
+        size_t size = (size_t)rows * stride * sizeof(BitWord);
+        words = static_cast<BitWord*>(arena.allocate(size));
+        memset(words, 0, size);
+      }
+
+      // forgets the rows, for when their arena is reset
+      void clear() {
+        words = NULL;
+        numRows = 0;
+      }
+
+      DenseRow row(unsigned r) {
+        return DenseRow(words + (size_t)r * stride, numBits, stride);
+      }
+
+      static const char *name() { return "dense"; }
+      uint64_t bytes() const { return (uint64_t)numRows * stride * sizeof(BitWord); }
+
+      /* dst = meet of rows first + step * idx[i] for i < k (k > 0), word
+       * by word across all of them rather than one row after another, so
+       * dst is written once however many rows there are */
+      void meetRows(DenseRow dst, MeetOp op, unsigned first, unsigned step, const unsigned *idx, unsigned k) {
+        if (op == MEET_INTERSECTION)
+          meetWords<true>(dst.words, words, first, step, idx, k, stride);
+        else
+          meetWords<false>(dst.words, words, first, step, idx, k, stride);
+      }
+    };
+
+    /* one SparseBitVector of a SparseMatrix, with the same interface as
+     * DenseRow. Only populated 128-bit chunks take up memory and time, which
+     * pays off when numBits is large and the sets are nearly empty. */
+    struct SparseRow {
+      SparseRow() : bits(NULL), numBits(0) {}
+      SparseRow(SparseBitVector<> *b, unsigned n) : bits(b), numBits(n) {}
+
+      SparseBitVector<> *bits;
+      unsigned numBits;
+
+      unsigned size() const { return numBits; }
+
+      bool operator[](unsigned i) const { return bits->test(i); }
+
+      void set(unsigned i) { bits->set(i); }
+      void reset(unsigned i) { bits->reset(i); }
+
+      void set() {
+        for (unsigned i = 0; i < numBits; i++) bits->set(i);
+      }
+
+      void reset() { bits->clear(); }
+
+      void copy(const SparseRow &o) { *bits = *o.bits; }
+      void load(const SparseRow &o) { *bits = *o.bits; }
+
+      bool assign(const SparseRow &o) {
+        if (*bits == *o.bits) return false;
+        *bits = *o.bits;
+        return true;
+      }
+
+      bool assignGenKill(const SparseRow &gen, const SparseRow &src, const SparseRow &kill) {
+        // intersectWithComplement rebuilds its target anyway, so a local
+        // costs no more than a kept one and rows can be updated concurrently
+        SparseBitVector<> tmp;
+        tmp.intersectWithComplement(*src.bits, *kill.bits);
+        tmp |= *gen.bits;
+        if (tmp == *bits) return false;
+        *bits = tmp;
+        return true;
+      }
+
+      SparseRow &operator|=(const SparseRow &o) { *bits |= *o.bits; return *this; }
+      SparseRow &operator&=(const SparseRow &o) { *bits &= *o.bits; return *this; }
+
+      bool operator==(const SparseRow &o) const { return *bits == *o.bits; }
+      bool operator!=(const SparseRow &o) const { return *bits != *o.bits; }
+
+      unsigned count() const { return bits->count(); }
+    };
+
+    // bits per SparseBitVector<> element
+    enum { SPARSE_CHUNK_BITS = 128 };
+
+    // same interface as DenseMatrix, one SparseBitVector per row
+    struct SparseMatrix {
+      SparseMatrix() : numRows(0), numBits(0) {}
+
+      typedef SparseRow Set;
+
+      std::vector<SparseBitVector<> > rows;
+      unsigned numRows;
+      unsigned numBits;
+
+      /* every row is cleared. The elements of a SparseBitVector come from
+       * the heap, so the arena is unused and clear() frees them. */
+      void resize(unsigned r, unsigned bits, Arena &) {
+        for (unsigned i = 0; i < rows.size() && i < r; i++) rows[i].clear();
+        rows.resize(r);
+        numRows = r;
+        numBits = bits;
+      }
+
+      void clear() {
+        std::vector<SparseBitVector<> >().swap(rows);
+        numRows = 0;
+      }
+
+      SparseRow row(unsigned r) { return SparseRow(&rows[r], numBits); }
+
+      static const char *name() { return "sparse"; }
+
+      // walks every set bit to count the 128-bit chunks, so not for hot paths
+      uint64_t bytes() const {
+        uint64_t chunks = 0;
+        for (unsigned r = 0; r < numRows; r++) {
+          unsigned last = ~0u;
+          for (SparseBitVector<>::iterator it = rows[r].begin(), ie = rows[r].end(); it != ie; ++it) {
+            if (*it / SPARSE_CHUNK_BITS != last) chunks++;
+            last = *it / SPARSE_CHUNK_BITS;
+          }
+        }
+        return rows.capacity() * sizeof(SparseBitVector<>) + chunks * sizeof(SparseBitVectorElement<SPARSE_CHUNK_BITS>);
+      }
+
+      // same as DenseMatrix::meetRows; a sparse row has no words to sweep
+      void meetRows(SparseRow dst, MeetOp op, unsigned first, unsigned step, const unsigned *idx, unsigned k) {
+        dst.copy(row(first + step * idx[0]));
+        for (unsigned i = 1; i < k; i++) {
+          if (op == MEET_INTERSECTION)
+            dst &= row(first + step * idx[i]);
+          else
+            dst |= row(first + step * idx[i]);
+        }
+      }
+    };
+
+    /* a DenseRow whose word count N is known at compile time, so every loop
+     * unrolls and a one or two word set is handled in registers */
+    template<unsigned N>
+    struct FixedRow {
+      FixedRow() : words(NULL), numBits(0) {}
+      FixedRow(BitWord *w, unsigned bits) : words(w), numBits(bits) {}
+
+      BitWord *words;
+      unsigned numBits;
+
+      unsigned size() const { return numBits; }
+
+      bool operator[](unsigned i) const {
+        return (words[i / BITWORD_SIZE] >> (i % BITWORD_SIZE)) & 1;
+      }
+
+      void set(unsigned i) { words[i / BITWORD_SIZE] |= BitWord(1) << (i % BITWORD_SIZE); }
+      void reset(unsigned i) { words[i / BITWORD_SIZE] &= ~(BitWord(1) << (i % BITWORD_SIZE)); }
+
+      void set() {
+        for (unsigned w = 0; w < N; w++) words[w] = ~BitWord(0);
+        clearTail();
+      }
+
+      void reset() {
+        for (unsigned w = 0; w < N; w++) words[w] = 0;
+      }
+
+      void copy(const FixedRow &o) {
+        for (unsigned w = 0; w < N; w++) words[w] = o.words[w];
+      }
+
+      // o's bits past its size are zero already
+      void load(const FixedRow &o) { copy(o); }
+
+      bool assign(const FixedRow &o) {
+        BitWord diff = 0;
+        for (unsigned w = 0; w < N; w++) {
+          diff |= words[w] ^ o.words[w];
+          words[w] = o.words[w];
+        }
+        return diff != 0;
+      }
+
+      bool assignGenKill(const FixedRow &gen, const FixedRow &src, const FixedRow &kill) {
+        BitWord diff = 0;
+        for (unsigned w = 0; w < N; w++) {
+          BitWord v = gen.words[w] | (src.words[w] & ~kill.words[w]);
+          diff |= words[w] ^ v;
+          words[w] = v;
+        }
+        return diff != 0;
+      }
+
+      FixedRow &operator|=(const FixedRow &o) {
+        for (unsigned w = 0; w < N; w++) words[w] |= o.words[w];
+        return *this;
+      }
+
+      FixedRow &operator&=(const FixedRow &o) {
+        for (unsigned w = 0; w < N; w++) words[w] &= o.words[w];
+        return *this;
+      }
+
+      bool operator==(const FixedRow &o) const {
+        BitWord diff = 0;
+        for (unsigned w = 0; w < N; w++) diff |= words[w] ^ o.words[w];
+        return diff == 0;
+      }
+
+      bool operator!=(const FixedRow &o) const { return !(*this == o); }
+
+      unsigned count() const {
+        unsigned n = 0;
+        for (unsigned w = 0; w < N; w++) n += CountPopulation_64(words[w]);
+        return n;
+      }
+
+      // bits past numBits are zero: the rest of their word, and every word after it
+      void clearTail() {
+        unsigned w = numBits / BITWORD_SIZE;
+        if (w < N && numBits % BITWORD_SIZE)
+          words[w++] &= (BitWord(1) << (numBits % BITWORD_SIZE)) - 1;
+        for (; w < N; w++) words[w] = 0;
+      }
+    };
+
+    // DenseMatrix for at most N * 64 bits
+    template<unsigned N>
+    struct FixedMatrix {
+      FixedMatrix() : words(NULL), numRows(0), numBits(0) {}
+
+      typedef FixedRow<N> Set;
+
+      // owned by the arena given to resize
+      BitWord *words;
+      unsigned numRows;
+      unsigned numBits;
+
+      // same as DenseMatrix::resize
+      void resize(unsigned rows, unsigned bits, Arena &arena) {
+        assert(bits <= N * BITWORD_SIZE && "too many bits for a FixedMatrix");
+        numRows = rows;
+        numBits = bits;
+        size_t size = (size_t)rows * N * sizeof(BitWord);
+        words = static_cast<BitWord*>(arena.allocate(size));
+        memset(words, 0, size);
+      }
+
+      void clear() {
+        words = NULL;
+        numRows = 0;
+      }
+
+      Set row(unsigned r) { return Set(words + (size_t)r * N, numBits); }
+
+      static const char *name() { return N == 1 ? "fixed64" : "fixed128"; }
+      uint64_t bytes() const { return (uint64_t)numRows * N * sizeof(BitWord); }
+
+      // same as DenseMatrix::meetRows, with the whole row in registers
+      void meetRows(Set dst, MeetOp op, unsigned first, unsigned step, const unsigned *idx, unsigned k) {
+        BitWord acc[N];
+        const BitWord *w = words + (size_t)(first + step * idx[0]) * N;
+        for (unsigned j = 0; j < N; j++) acc[j] = w[j];
+        for (unsigned i = 1; i < k; i++) {
+          w = words + (size_t)(first + step * idx[i]) * N;
+          for (unsigned j = 0; j < N; j++) {
+            acc[j] = op == MEET_INTERSECTION ? acc[j] & w[j] : acc[j] | w[j];
+          }
+        }
+        for (unsigned j = 0; j < N; j++) dst.words[j] = acc[j];
+      }
+    };
+
+    // largest width handled by FixedMatrix<1> and FixedMatrix<2>
+    enum { FIXED1_MAX_BITS = BITWORD_SIZE, FIXED2_MAX_BITS = 2 * BITWORD_SIZE };
+
+    /* Picks the set representation for one function. A dense row costs
+     * numBits/64 words in every meet and compare whatever it holds, a sparse
+     * one costs a list node per populated 128 bits. density is the analysis'
+     * bound on the fraction of bits set in a block boundary set, e.g. the
+     * share of values used outside their defining block for liveness. */
+    enum { SPARSE_MIN_BITS = 4096 };
+
+    inline bool useSparseSets(unsigned numBits, double density) {
+      return numBits >= SPARSE_MIN_BITS && density * 32 < 1;
+    }
+
+    // the parts of a function's analysis SolverStats::time is split into
+    enum Phase { PHASE_INDEX, PHASE_ORDER, PHASE_SUMMARY, PHASE_SOLVE, PHASE_OUTPUT, NUM_PHASES };
+
+    inline const char *phaseName(unsigned p) {
+      static const char *names[NUM_PHASES] = { "index", "order", "summary", "solve", "output" };
+      return names[p];
+    }
+
+    // seconds on a monotonic clock
+    inline double wallTime() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    /* What the solver did for one function. The index and output phases
+     * belong to the analysis, which fills them in itself. */
+    struct SolverStats {
+      SolverStats() { clear(); }
+
+      std::string function;
+      // representation of the sets
+      const char *storage;
+      unsigned blocks;
+      // bits per set
+      unsigned values;
+      // strongly connected components, if solved that way
+      unsigned components;
+      // blocks added to and taken off the worklist
+      uint64_t pushes, pops;
+      // block transfer functions applied
+      uint64_t transfers;
+      // sets merged into another by the meet
+      uint64_t meets;
+      // the most times any one block was recomputed
+      unsigned iterations;
+      // most memory taken by the in/out/gen/kill sets
+      uint64_t setBytes;
+      double time[NUM_PHASES];
+
+      void clear() {
+        function.clear();
+        storage = "";
+        blocks = values = components = iterations = 0;
+        pushes = pops = transfers = meets = setBytes = 0;
+        for (unsigned p = 0; p < NUM_PHASES; p++) time[p] = 0;
+      }
+    };
+
+    // empties v, returning its memory unless that is small enough to reuse
+    template<class T>
+    inline void trim(std::vector<T> &v) {
+      if (v.capacity() * sizeof(T) > Arena::CHUNK_BYTES) std::vector<T>().swap(v);
+      else v.clear();
+    }
+
+    /* Dense ids for the arguments and instructions of one function, shared
+     * by the analyses as their bit numbering. The analysis add()s values in
+     * the order it wants their bits, then index() lays the function out in
+     * program order: for the instruction at position p, its own id and the
+     * ids of its operands sit in flat arrays, so a transfer that walks a
+     * block goes by position and never hashes. Looking up a Value* (ids,
+     * position) hashes once and is meant for phis, queries and printing.
+     * NONE stands for values without an id: constants, globals, blocks. */
+    struct ValueNumbering {
+      enum { NONE = ~0u };
+
+      // by id
+      std::vector<Value*> values;
+      DenseMap<Value*, unsigned> ids;
+
+      // by position, filled by index()
+      std::vector<Instruction*> insts;
+      std::vector<unsigned> instIds;
+      // ids of the operands of insts[p]: operands[opStart[p]] .. operands[opStart[p+1]-1]
+      std::vector<unsigned> opStart, operands;
+      DenseMap<Instruction*, unsigned> positions;
+      // positions of the first instruction of each block, and one past its last
+      DenseMap<BasicBlock*, std::pair<unsigned, unsigned> > blocks;
+
+      unsigned size() const { return values.size(); }
+
+      unsigned add(Value *v) {
+        ids[v] = values.size();
+        values.push_back(v);
+        return values.size() - 1;
+      }
+
+      unsigned lookup(Value *v) const {
+        DenseMap<Value*, unsigned>::const_iterator it = ids.find(v);
+        return it == ids.end() ? (unsigned)NONE : it->second;
+      }
+
+      Value *value(unsigned id) const { return values[id]; }
+
+      // once every id is assigned
+      void index(Function &F) {
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          layOut(&*bb);
+        }
+        opStart.push_back(operands.size());
+        // so &operands[0] is there even if nothing has operands
+        operands.push_back(NONE);
+      }
+
+      /* lays bb out again, after the end, once instructions in it have been
+       * erased or had operands replaced. Its old positions are left unused.
+       * Ids stay as they are: an erased value keeps its id, and an added
+       * one gets none. */
+      void reindex(BasicBlock *bb) {
+        std::pair<unsigned, unsigned> old = block(bb);
+        for (unsigned p = old.first; p < old.second; p++) {
+          // only the key, insts[p] may be gone and its address taken by a new instruction elsewhere
+          DenseMap<Instruction*, unsigned>::iterator it = positions.find(insts[p]);
+          if (it != positions.end() && it->second == p) positions.erase(it);
+        }
+        operands.pop_back();
+        opStart.pop_back();
+        layOut(bb);
+        opStart.push_back(operands.size());
+        operands.push_back(NONE);
+      }
+
+      void layOut(BasicBlock *bb) {
+        unsigned first = insts.size();
+        for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+          positions[&*ii] = insts.size();
+          insts.push_back(&*ii);
+          instIds.push_back(lookup(&*ii));
+          opStart.push_back(operands.size());
+          for (User::op_iterator OI = ii->op_begin(), OE = ii->op_end(); OI != OE; ++OI) {
+            operands.push_back(lookup(*OI));
+          }
+        }
+        blocks[bb] = std::make_pair(first, (unsigned)insts.size());
+      }
+
+      /* before v is deleted: its id stays taken, but nothing new at the
+       * same address will be mistaken for it */
+      void erase(Value *v) {
+        DenseMap<Value*, unsigned>::iterator it = ids.find(v);
+        if (it == ids.end()) return;
+        values[it->second] = NULL;
+        ids.erase(it);
+      }
+
+      unsigned position(Instruction *I) const { return positions.find(I)->second; }
+
+      std::pair<unsigned, unsigned> block(BasicBlock *bb) const { return blocks.find(bb)->second; }
+
+      const unsigned *opBegin(unsigned p) const { return &operands[0] + opStart[p]; }
+      const unsigned *opEnd(unsigned p) const { return &operands[0] + opStart[p + 1]; }
+
+      void clear() {
+        trim(values);
+        ids.clear();
+        trim(insts);
+        trim(instIds);
+        trim(opStart);
+        trim(operands);
+        positions.clear();
+        blocks.clear();
+      }
+    };
+
+    /* pointer-keyed access to rows of a DenseMatrix or SparseMatrix. Key k
+     * gets row first + step * number[k], so in[] and out[] can share one matrix. */
+    template<class KeyT, class Storage>
+    struct SetMap {
+      SetMap(Storage *m, DenseMap<KeyT, unsigned> *n, unsigned f, unsigned s)
+        : matrix(m), number(n), first(f), step(s) {}
+
+      typedef typename Storage::Set Set;
+
+      Storage *matrix;
+      DenseMap<KeyT, unsigned> *number;
+      unsigned first;
+      unsigned step;
+
+      // by key number
+      Set operator[](unsigned i) const { return matrix->row(first + step * i); }
+
+      Set operator[](KeyT k) const { return (*this)[(*number)[k]]; }
+    };
+
+    /* The solver. Storage (DenseMatrix, SparseMatrix or FixedMatrix<N>)
+     * decides how the sets are represented; analyses that want to choose per
+     * function are written as templates over it.
+     *
+     * The analysis is the Derived class, and every hook (meet, transfer...)
+     * is called on it directly, so they inline into the solver loop. Derived
+     * must provide getBoundaryCondition, meet, initialInteriorPoint and
+     * transferInstruction (see Dataflow below for what each does), and can
+     * hide the defaults of the others. Dataflow is the same solver with the
+     * hooks as virtual functions. */
+    template<class Derived, bool forward, class Storage>
+    struct DataflowSolver
     {
-        Dataflow() {
-          in = new DomainMap();
-          out = new DomainMap();
+        DataflowSolver() {
+          in = new BlockSets(&sets, &number, 0, 2);
+          out = new BlockSets(&sets, &number, 1, 2);
+          nextPoints = 0;
+          pointWidth = 0;
+          sccThreads = 0;
+          edgesChanged = false;
         }
      
-     	typedef ValueMap<BasicBlock*, BitVector*> DomainMap;
-     	
-     	// in[b] where b is a basic block
-     	DomainMap *in;
-     	
-     	// out[b] where out is a basic block
-     	DomainMap *out;
-     	
-		// bitvector such that meet(x, top) = x
-		// must be specified by subclass
-     	BitVector *top;
-     	
-        ~Dataflow() {
-        	for (DomainMap::iterator i = in->begin(), ie = in->end(); i != ie; i++) {
-            	delete i->second;
-        	}
-        	for (DomainMap::iterator i = out->begin(), ie = out->end(); i != ie; i++) {
-            	delete i->second;
-          	}
-          	delete top;
-        }
-     	
-        virtual bool runOnFunction(Function &f) {
-        
-            BasicBlock& entry = f.getEntryBlock();
-            
+        typedef typename Storage::Set Set;
+        typedef SetMap<BasicBlock*, Storage> BlockSets;
+
+        // in[b] where b is a basic block
+        BlockSets *in;
+
+        // out[b] where out is a basic block
+        BlockSets *out;
+
+        /* storage behind in and out: rows 2b and 2b+1 hold in and out of the
+         * block numbered b, the rows after the last block are scratch space,
+         * one per solver thread. With block summaries every block gets four
+         * rows: in, out, gen, kill. */
+        Storage sets;
+        unsigned rowsPerBlock;
+
+        // number of bits in every set
+        // must be specified by subclass
+        unsigned width;
+
+        /* number of bits in the sets handed out by setBefore/setAfter, if the
+         * analysis tracks values there that never reach a block boundary.
+         * Those get the bits from width up; they must not be touched by
+         * getBlockSummary, and the analysis needs block summaries since the
+         * boundary sets have no room for them. 0 means the same as width. */
+        unsigned pointWidth;
+
+        unsigned pointBits() const { return pointWidth > width ? pointWidth : width; }
+
+        /* 0 to solve the whole CFG with one worklist. Otherwise the strongly
+         * connected components of the CFG are solved one at a time, each to
+         * its own fixed point, in the order the data flows through them; with
+         * more than one thread, components whose inputs are final are solved
+         * concurrently. Pays off on huge functions with many loops. */
+        unsigned sccThreads;
+
+        ~DataflowSolver() {
+          delete in;
+          delete out;
+        }
+
+        Derived &derived() { return *static_cast<Derived*>(this); }
+
+        bool runOnFunction(Function &f) {
+            stats.clear();
+            stats.function = f.getName().str();
+            stats.storage = Storage::name();
+            double start = wallTime();
+            traceBegin("order", f);
+
+            // number the blocks in the order we want to visit them
+            computeOrder(f);
+            changed.clear();
+            edgesChanged = false;
+            unsigned n = order.size();
+            clearPoints();
+            rowsPerBlock = derived().hasBlockSummaries() ? 4 : 2;
+            in->step = out->step = rowsPerBlock;
+            if (sccThreads) computeComponents();
+            unsigned workers = sccThreads ? std::min(sccThreads, numComponents()) : 1;
+            arena.reset();
+            sets.resize(rowsPerBlock * n + std::max(workers, 1u), width, arena);
+            walk.resize(1, pointBits(), arena);
+            visits.assign(n, 0);
+            stats.blocks = n;
+            stats.values = pointBits();
+            stats.components = sccThreads ? numComponents() : 0;
+            stats.time[PHASE_ORDER] = wallTime() - start;
+            traceEnd("order", f);
+            start = wallTime();
+            traceBegin("summary", f);
+
+            // summarize each block once, up front
+            if (rowsPerBlock == 4) {
+              for (unsigned b = 0; b < n; b++) {
+                derived().getBlockSummary(*order[b], gen(b), kill(b));
+              }
+            }
+            stats.time[PHASE_SUMMARY] = wallTime() - start;
+            traceEnd("summary", f);
+            start = wallTime();
+            traceBegin("solve", f);
+
             // initialize in and out
-            for (Function::iterator bi = f.begin(), be = f.end(); bi != be; bi++) {
+            for (unsigned b = 0; b < n; b++) {
                 if (forward) {
                 	/* Forward flow means we need to first apply meet with out[b]
                 	   for all incoming blocks, b.
                 	   
                 	   With loops, out[b] may not always have been generated already,
-                	   so we need initial interior points. */
-                	(*out)[&(*bi)] = initialInteriorPoint(*bi);
-                	
-                	/* just a dummy bitvector of the same length as top,
-                	   it will never be read before being written to */
-                	(*in)[&(*bi)] = new BitVector(*top);
+                	   so we need initial interior points. in[b] is never read
+                	   before being written to. */
+                	derived().initialInteriorPoint(*order[b], (*out)[b]);
                 } else {
                 	// opposite logic for reverse flow
-                	(*in)[&(*bi)] = initialInteriorPoint(*bi);
-                	(*out)[&(*bi)] = new BitVector(*top);
+                	derived().initialInteriorPoint(*order[b], (*in)[b]);
                 	
                 	// there isn't a unique exit node so we apply the boundary condition
                 	// when we reach a node with no successors in the loop below...
@@ -81,122 +890,1313 @@ namespace
 
            if (forward)            
               // boundary conditions for entry node
-              getBoundaryCondition((*in)[&entry]);         
-
-            
-            /* worklist maintains a list of all basic blocks on whom the transfer 
-             * function needs to be applied.*/
-            std::list<BasicBlock*> *worklist = new std::list<BasicBlock*>();
+              derived().getBoundaryCondition((*in)[&f.getEntryBlock()]);         
 
-            //Initially, every node is in the worklist
-            bfs(f,*worklist); 
+            uint64_t initialBytes = sets.bytes();
+            if (derived().solveDirectly(f)) {
+              // in and out are final already
+            } else if (sccThreads) {
+              solveComponents(workers);
+            } else {
+              /* worklist maintains the set of basic blocks on whom the transfer 
+               * function needs to be applied, keyed by block number. */
+              Worklist worklist(n);
 
-            if (!forward)
-              //for backward passes, start at exit nodes and work backwards
-              worklist->reverse(); 
+              //Initially, every node is in the worklist
+              for (unsigned i = 0; i < n; i++) {
+                worklist.push(i);
+              }
 
-            while (!worklist->empty()) {
-              if (forward) {
-                reversePostOrder(*worklist);
-              } else {
-                postOrder(*worklist);
+              while (!worklist.empty()) {
+                if (forward) {
+                  reversePostOrder(worklist, scratch(0), ALL_BLOCKS);
+                } else {
+                  postOrder(worklist, scratch(0), ALL_BLOCKS);
+                }
               }
+              worklist.addTo(stats);
             }
 
-            delete worklist;
+            stats.time[PHASE_SOLVE] = wallTime() - start;
+            traceEnd("solve", f);
+            stats.setBytes = std::max(initialBytes, sets.bytes());
+            for (unsigned b = 0; b < n; b++) {
+              stats.iterations = std::max(stats.iterations, visits[b]);
+            }
             return false;
         }
 
-        virtual void bfs(Function &f, std::list<BasicBlock*> &worklist) {
-          BasicBlock * curNode;
-          ValueMap<BasicBlock*, bool> *visited = new ValueMap<BasicBlock*,bool>();
+        /* Frees what the last runOnFunction left, other than stats. in, out
+         * and setBefore/setAfter are no good until the next one. Passes call
+         * this from releaseMemory, once they are done with a function. */
+        void releaseMemory() {
+          sets.clear();
+          walk.clear();
+          queryRows.clear();
+          trim(summaries); trim(summarized);
+          answers.clear();
+          trim(seen); trim(cameFrom); trim(visited);
+          // release, not reset: nothing is kept for a next function
+          arena.release();
+          clearPoints(true);
+          trim(order);
+          number.clear();
+          trim(preds); trim(predStart);
+          trim(succs); trim(succStart);
+          trim(component); trim(componentBlocks); trim(componentStart);
+          trim(visits);
+          trim(changed);
+        }
+
+        /* Keeping in and out right while a pass rewrites the function. Report
+         * each change as it is made, then call update() before in, out or
+         * setBefore/setAfter are used again. Only the blocks the changes can
+         * reach, in the direction of the analysis, are solved again; they
+         * start over from their initial sets, since a set can shrink as well
+         * as grow, and every other block keeps what it had, as nothing that
+         * flows into it changed.
+         *
+         * Instructions can be erased or have their operands replaced, and
+         * edges can come and go. New definitions and new blocks have no bits
+         * or rows, so those take a fresh runOnFunction. */
+        void instructionChanged(Instruction *I) { markChanged(I->getParent()); }
+
+        // before I->eraseFromParent()
+        void instructionErased(Instruction *I) {
+          markChanged(I->getParent());
+          derived().erasing(*I);
+        }
+
+        // before from->replaceAllUsesWith(to)
+        void usesReplaced(Value *from, Value *to) {
+          for (Value::use_iterator UI = from->use_begin(), UE = from->use_end(); UI != UE; ++UI) {
+            if (Instruction *user = dyn_cast<Instruction>(*UI))
+              markChanged(user->getParent());
+          }
+          derived().replacing(from, to);
+        }
+
+        // with from's terminator changed to match
+        void edgeAdded(BasicBlock *from, BasicBlock *to) { edgeChanged(from, to); }
+        void edgeRemoved(BasicBlock *from, BasicBlock *to) { edgeChanged(from, to); }
+
+        // blocks reported changed since the last update, maybe more than once
+        std::vector<unsigned> changed;
+        bool edgesChanged;
+
+        void markChanged(BasicBlock *bb) { changed.push_back(number[bb]); }
+
+        void edgeChanged(BasicBlock *from, BasicBlock *to) {
+          edgesChanged = true;
+          markChanged(from);
+          markChanged(to);
+        }
+
+        void update() {
+          if (changed.empty()) return;
+          double start = wallTime();
+          if (edgesChanged) computeEdges();
+          edgesChanged = false;
+          clearPoints();
+
+          // the changed blocks are summarized again, then everything they flow into joins them
+          unsigned n = order.size();
+          std::vector<bool> affected(n, false);
+          std::vector<unsigned> region;
+          for (unsigned i = 0; i < changed.size(); i++) {
+            unsigned b = changed[i];
+            if (affected[b]) continue;
+            affected[b] = true;
+            region.push_back(b);
+            derived().blockChanged(*order[b]);
+            if (rowsPerBlock == 4) {
+              gen(b).reset();
+              kill(b).reset();
+              derived().getBlockSummary(*order[b], gen(b), kill(b));
+            }
+          }
+          changed.clear();
+          for (unsigned i = 0; i < region.size(); i++) {
+            unsigned b = region[i];
+            for (unsigned e = flowBegin(b); e != flowEnd(b); e++) {
+              unsigned t = flowTarget(e);
+              if (!affected[t]) {
+                affected[t] = true;
+                region.push_back(t);
+              }
+            }
+          }
+
+          // as runOnFunction leaves them before solving
+          Worklist worklist(n);
+          for (unsigned i = 0; i < region.size(); i++) {
+            unsigned b = region[i];
+            if (forward) {
+              derived().initialInteriorPoint(*order[b], (*out)[b]);
+              // in[entry] keeps the boundary condition; other blocks with no predecessors never get one
+              if (b != 0 && predStart[b] == predStart[b + 1]) (*in)[b].reset();
+            } else {
+              derived().initialInteriorPoint(*order[b], (*in)[b]);
+            }
+            worklist.push(b);
+          }
+          while (!worklist.empty()) {
+            if (forward) {
+              reversePostOrder(worklist, scratch(0), ALL_BLOCKS);
+            } else {
+              postOrder(worklist, scratch(0), ALL_BLOCKS);
+            }
+          }
+          worklist.addTo(stats);
+          stats.time[PHASE_SOLVE] += wallTime() - start;
+        }
+
+        // counters for the last runOnFunction
+        SolverStats stats;
+
+        // times each block was recomputed
+        std::vector<unsigned> visits;
+
+        /* priority worklist over block numbers. Always hands back the lowest
+         * numbered pending block, and a block that is already pending is not
+         * added a second time. */
+        struct Worklist {
+          Worklist(unsigned n) : queued(n, false), pushes(0), pops(0), transfers(0), meets(0) {
+            // a block is queued at most once, so the heap never needs to grow
+            heap.reserve(n);
+          }
+
+          void push(unsigned b) {
+            if (!queued[b]) {
+              pushes++;
+              queued[b] = true;
+              heap.push_back(b);
+              std::push_heap(heap.begin(), heap.end(), std::greater<unsigned>());
+            }
+          }
+
+          unsigned pop() {
+            pops++;
+            std::pop_heap(heap.begin(), heap.end(), std::greater<unsigned>());
+            unsigned b = heap.back();
+            heap.pop_back();
+            queued[b] = false;
+            return b;
+          }
+
+          bool empty() const { return heap.empty(); }
+
+          // min-heap of block numbers
+          std::vector<unsigned> heap;
+          std::vector<bool> queued;
+
+          // work done by the thread owning this worklist, for SolverStats
+          uint64_t pushes, pops, transfers, meets;
+
+          void addTo(SolverStats &st) const {
+            st.pushes += pushes;
+            st.pops += pops;
+            st.transfers += transfers;
+            st.meets += meets;
+          }
+        };
+
+        // blocks in visiting order: order[number[b]] == b
+        std::vector<BasicBlock*> order;
+        DenseMap<BasicBlock*, unsigned> number;
+
+        /* block numbers of the CFG neighbours, flattened: the predecessors of
+         * block b are preds[predStart[b]] .. preds[predStart[b+1]-1] */
+        std::vector<unsigned> preds, predStart;
+        std::vector<unsigned> succs, succStart;
+
+        /* Forward problems visit blocks in reverse post-order from the entry.
+         * Backward problems visit them in reverse post-order of the reverse CFG,
+         * starting from the exit blocks. Blocks not reached that way (dead code,
+         * or loops that never exit) are numbered after everything else. */
+        void computeOrder(Function &f) {
+          order.clear();
+          number.clear();
+
+          DenseMap<BasicBlock*, bool> visited;
+          std::vector<BasicBlock*> roots;
+          if (forward) {
+            roots.push_back(&f.getEntryBlock());
+          } else {
+            for (Function::iterator bb = f.begin(), be = f.end(); bb != be; bb++) {
+              if (succ_begin(&*bb) == succ_end(&*bb))
+                roots.push_back(&*bb);
+            }
+          }
+          dfsOrder(roots, visited);
 
           for (Function::iterator bb = f.begin(), be = f.end(); bb != be; bb++) {
-            (*visited)[&*bb] = false;
+            if (!visited.count(&*bb)) {
+              std::vector<BasicBlock*> rest(1, &*bb);
+              dfsOrder(rest, visited);
+            }
+          }
+
+          for (unsigned i = 0; i < order.size(); i++) {
+            number[order[i]] = i;
           }
+          computeEdges();
+        }
+
+        // the CSR lists below from the CFG, with the blocks numbered already
+        void computeEdges() {
+          preds.clear(); predStart.clear();
+          succs.clear(); succStart.clear();
+          for (unsigned i = 0; i < order.size(); i++) {
+            predStart.push_back(preds.size());
+            for (pred_iterator PI = pred_begin(order[i]), PE = pred_end(order[i]); PI != PE; PI++)
+              preds.push_back(number[*PI]);
+            succStart.push_back(succs.size());
+            for (succ_iterator SI = succ_begin(order[i]), SE = succ_end(order[i]); SI != SE; SI++)
+              succs.push_back(number[*SI]);
+          }
+          predStart.push_back(preds.size());
+          succStart.push_back(succs.size());
+        }
 
-          std::list<BasicBlock*> *l = new std::list<BasicBlock*>();
+        // one level of the explicit dfs stack used by dfsOrder
+        struct Frame {
+          Frame(BasicBlock *b) : bb(b), succ(succ_begin(b)), pred(pred_begin(b)) {}
+          BasicBlock *bb;
+          succ_iterator succ;
+          pred_iterator pred;
+        };
 
-          l->push_back(&f.getEntryBlock());
-          while (!l->empty()) {
-            curNode = *(l->begin());
-            l->pop_front();
-            worklist.push_back(curNode);
+        /* appends the reverse post-order of everything reachable from roots
+         * (along successors if forward, predecessors otherwise) to order.
+         * Uses an explicit stack so deep CFGs can't overflow the call stack. */
+        void dfsOrder(std::vector<BasicBlock*> &roots, DenseMap<BasicBlock*, bool> &visited) {
+          std::vector<BasicBlock*> post;
+          std::vector<Frame> stack;
 
-            (*visited)[curNode] = true;
-            for (succ_iterator SI = succ_begin(curNode), SE = succ_end(curNode); SI != SE; SI++) {
-              if (!(*visited)[*SI]) {
-                l->push_back(*SI);
+          for (unsigned r = 0; r < roots.size(); r++) {
+            if (visited.count(roots[r])) continue;
+            visited[roots[r]] = true;
+            stack.push_back(Frame(roots[r]));
+
+            while (!stack.empty()) {
+              Frame &top = stack.back();
+              BasicBlock *child = NULL;
+              if (forward) {
+                if (top.succ != succ_end(top.bb))
+                  child = *top.succ++;
+              } else {
+                if (top.pred != pred_end(top.bb))
+                  child = *top.pred++;
+              }
+
+              if (!child) {
+                // all children done
+                post.push_back(top.bb);
+                stack.pop_back();
+              } else if (!visited.count(child)) {
+                visited[child] = true;
+                stack.push_back(Frame(child));
               }
             }
           }
 
-          delete visited;
-          delete l;
+          order.insert(order.end(), post.rbegin(), post.rend());
         }
 
-        virtual void reversePostOrder(std::list<BasicBlock*> &q) {
-          BasicBlock * curNode = *q.begin();
-          q.pop_front();
+        // the scc argument of reversePostOrder/postOrder when not solving by component
+        enum { ALL_BLOCKS = ~0u };
+
+        /* pops a block off q and recomputes it. If it changed, the blocks that
+         * depend on it are queued, only those in component scc unless that is
+         * ALL_BLOCKS. scratch is the calling thread's scratch row. */
+        void reversePostOrder(Worklist &q, Set scratch, unsigned scc) {
+          unsigned b = q.pop();
+          Set curIn = (*in)[b];
+          visits[b]++;
 
-          pred_iterator PI = pred_begin(curNode), 
-                        PE = pred_end(curNode);
-          if (PI != PE) {
+          unsigned PI = predStart[b], PE = predStart[b + 1];
+          q.meets += PE - PI;
+          if (PI != PE && derived().meetOp() != MEET_CUSTOM) {
+            // all predecessors in one sweep
+            sets.meetRows(curIn, derived().meetOp(), out->first, out->step, &preds[PI], PE - PI);
+          } else if (PI != PE) {
             // begin with a copy of out[first predecessor]
-            *(*in)[curNode] = *(*out)[*PI];  
+            curIn.copy((*out)[preds[PI]]);
 
             // fold meet over predecessors
             for (PI++; PI != PE; PI++) {
-              meet((*in)[curNode], (*out)[*PI]);
+              derived().meet(curIn, (*out)[preds[PI]]);
             }
           } // (otherwise entry node, in[entry] already set above)
 
-          // apply transfer function
-          BitVector* newOut = transfer(*curNode);
-          if (*newOut != *(*out)[curNode]) {
-            // copy new value
-            *(*out)[curNode] = *newOut;
-            for (succ_iterator SI = succ_begin(curNode), SE = succ_end(curNode); SI != SE; SI++) {
-              q.push_back(*SI);
+          // apply transfer function, which updates out[b] in place
+          q.transfers++;
+          if (applyTransfer(b, scratch)) {
+            for (unsigned SI = succStart[b], SE = succStart[b + 1]; SI != SE; SI++) {
+              if (scc == ALL_BLOCKS || component[succs[SI]] == scc)
+                q.push(succs[SI]);
             }
           }
-          delete newOut;
         }
         
-        virtual void postOrder(std::list<BasicBlock*> &q) {
-          BasicBlock *curNode = *q.begin();
-          q.pop_front();
+        void postOrder(Worklist &q, Set scratch, unsigned scc) {
+          unsigned b = q.pop();
+          Set curOut = (*out)[b];
+          visits[b]++;
         	
-          succ_iterator SI = succ_begin(curNode), SE = succ_end(curNode);
-          if (SI != SE) {
+          unsigned SI = succStart[b], SE = succStart[b + 1];
+          q.meets += SE - SI;
+          if (SI != SE && derived().meetOp() != MEET_CUSTOM) {
+            // all successors in one sweep
+            sets.meetRows(curOut, derived().meetOp(), in->first, in->step, &succs[SI], SE - SI);
+          } else if (SI != SE) {
             // begin with a copy of in[first successor]
-            *(*out)[curNode] = *(*in)[*SI];
+            curOut.copy((*in)[succs[SI]]);
 
             // fold meet operator over successors
             for (SI++; SI != SE; SI++) {
-              meet((*out)[curNode], (*in)[*SI]);
+              derived().meet(curOut, (*in)[succs[SI]]);
             }
           } else {
             // boundary condition when it is an exit block
-            getBoundaryCondition((*out)[curNode]);
+            derived().getBoundaryCondition(curOut);
           }
 
-          // apply transfer function
-          BitVector* newIn = transfer(*curNode);
-          if (*newIn != *(*in)[curNode]) {
-            // copy new value
-            *(*in)[curNode] = *newIn;
-            for (pred_iterator PI = pred_begin(curNode), PE = pred_end(curNode); PI != PE; PI++) {
-              q.push_back(*PI);
+          // apply transfer function, which updates in[b] in place
+          q.transfers++;
+          if (applyTransfer(b, scratch)) {
+            for (unsigned PI = predStart[b], PE = predStart[b + 1]; PI != PE; PI++) {
+              if (scc == ALL_BLOCKS || component[preds[PI]] == scc)
+                q.push(preds[PI]);
             }
           }
-          delete newIn;
         }
-        
-        virtual void getBoundaryCondition(BitVector*) = 0;
-        virtual void meet(BitVector*, const BitVector*) = 0;
-        virtual BitVector * initialInteriorPoint(BasicBlock&) = 0;
-        virtual BitVector* transfer(BasicBlock&) = 0;
+
+        /* Strongly connected components of the CFG, numbered in the order
+         * Tarjan's algorithm completes them: if data flows from component c
+         * to d then c > d. Blocks of component c, by block number, are
+         * componentBlocks[componentStart[c]] .. [componentStart[c+1]-1]. */
+        std::vector<unsigned> component;
+        std::vector<unsigned> componentBlocks, componentStart;
+
+        unsigned numComponents() const { return componentStart.empty() ? 0 : componentStart.size() - 1; }
+
+        // blocks that block b's result flows into
+        unsigned flowBegin(unsigned b) const { return forward ? succStart[b] : predStart[b]; }
+        unsigned flowEnd(unsigned b) const { return forward ? succStart[b + 1] : predStart[b + 1]; }
+        unsigned flowTarget(unsigned e) const { return forward ? succs[e] : preds[e]; }
+
+        // Tarjan's algorithm over the CSR lists, with an explicit stack
+        void computeComponents() {
+          unsigned n = order.size();
+          const unsigned NONE = ~0u;
+          std::vector<unsigned> dfsNum(n, NONE), low(n), stack;
+          std::vector<bool> onStack(n, false);
+          // (block, next edge) of each level of the recursion
+          std::vector<std::pair<unsigned, unsigned> > calls;
+          unsigned counter = 0, numSCC = 0;
+
+          component.assign(n, NONE);
+          for (unsigned root = 0; root < n; root++) {
+            if (dfsNum[root] != NONE) continue;
+            calls.push_back(std::make_pair(root, flowBegin(root)));
+            dfsNum[root] = low[root] = counter++;
+            stack.push_back(root);
+            onStack[root] = true;
+
+            while (!calls.empty()) {
+              unsigned v = calls.back().first;
+              unsigned &e = calls.back().second;
+              if (e != flowEnd(v)) {
+                unsigned w = flowTarget(e++);
+                if (dfsNum[w] == NONE) {
+                  dfsNum[w] = low[w] = counter++;
+                  stack.push_back(w);
+                  onStack[w] = true;
+                  calls.push_back(std::make_pair(w, flowBegin(w)));
+                } else if (onStack[w]) {
+                  low[v] = std::min(low[v], dfsNum[w]);
+                }
+                continue;
+              }
+
+              // all edges of v done
+              if (low[v] == dfsNum[v]) {
+                unsigned w;
+                do {
+                  w = stack.back();
+                  stack.pop_back();
+                  onStack[w] = false;
+                  component[w] = numSCC;
+                } while (w != v);
+                numSCC++;
+              }
+              calls.pop_back();
+              if (!calls.empty()) {
+                unsigned parent = calls.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+              }
+            }
+          }
+
+          // bucket the blocks by component, keeping block order within each
+          componentStart.assign(numSCC + 1, 0);
+          for (unsigned b = 0; b < n; b++) componentStart[component[b] + 1]++;
+          for (unsigned c = 0; c < numSCC; c++) componentStart[c + 1] += componentStart[c];
+          componentBlocks.resize(n);
+          std::vector<unsigned> fill(componentStart.begin(), componentStart.end() - 1);
+          for (unsigned b = 0; b < n; b++) componentBlocks[fill[component[b]]++] = b;
+        }
+
+        /* state shared by the threads of solveComponents. A component is
+         * ready once every edge flowing into it comes from a finished one. */
+        struct ComponentQueue {
+          pthread_mutex_t lock;
+          pthread_cond_t wake;
+          std::vector<unsigned> ready;
+          // per component, edges from components that are not finished yet
+          std::vector<unsigned> pending;
+          unsigned unfinished;
+        };
+
+        ComponentQueue *components;
+
+        // argument of the pthread entry point
+        struct ComponentWorker {
+          DataflowSolver *solver;
+          unsigned id;
+        };
+
+        static void *startComponentWorker(void *arg) {
+          ComponentWorker *w = static_cast<ComponentWorker*>(arg);
+          w->solver->componentWorker(w->id);
+          return NULL;
+        }
+
+        void solveComponents(unsigned workers) {
+          unsigned numSCC = numComponents();
+          ComponentQueue q;
+          pthread_mutex_init(&q.lock, NULL);
+          pthread_cond_init(&q.wake, NULL);
+          q.pending.assign(numSCC, 0);
+          q.unfinished = numSCC;
+          for (unsigned b = 0; b < order.size(); b++) {
+            for (unsigned e = flowBegin(b); e != flowEnd(b); e++) {
+              if (component[flowTarget(e)] != component[b])
+                q.pending[component[flowTarget(e)]]++;
+            }
+          }
+          for (unsigned c = 0; c < numSCC; c++) {
+            if (!q.pending[c]) q.ready.push_back(c);
+          }
+          components = &q;
+
+          // the calling thread is worker 0
+          std::vector<ComponentWorker> args(workers);
+          std::vector<pthread_t> threads(workers);
+          unsigned started = 1;
+          for (unsigned w = 0; w < workers; w++) {
+            args[w].solver = this;
+            args[w].id = w;
+          }
+          for (unsigned w = 1; w < workers; w++, started++) {
+            if (pthread_create(&threads[w], NULL, startComponentWorker, &args[w]) != 0)
+              break;
+          }
+          componentWorker(0);
+          for (unsigned w = 1; w < started; w++) {
+            pthread_join(threads[w], NULL);
+          }
+
+          components = NULL;
+          pthread_cond_destroy(&q.wake);
+          pthread_mutex_destroy(&q.lock);
+        }
+
+        // takes ready components and solves them until all are finished
+        void componentWorker(unsigned w) {
+          ComponentQueue &q = *components;
+          Worklist worklist(order.size());
+
+          pthread_mutex_lock(&q.lock);
+          while (q.unfinished) {
+            if (q.ready.empty()) {
+              pthread_cond_wait(&q.wake, &q.lock);
+              continue;
+            }
+            unsigned c = q.ready.back();
+            q.ready.pop_back();
+            pthread_mutex_unlock(&q.lock);
+
+            solveComponent(c, worklist, scratch(w));
+
+            pthread_mutex_lock(&q.lock);
+            q.unfinished--;
+            for (unsigned i = componentStart[c]; i < componentStart[c + 1]; i++) {
+              unsigned b = componentBlocks[i];
+              for (unsigned e = flowBegin(b); e != flowEnd(b); e++) {
+                unsigned d = component[flowTarget(e)];
+                if (d != c && --q.pending[d] == 0)
+                  q.ready.push_back(d);
+              }
+            }
+            pthread_cond_broadcast(&q.wake);
+          }
+          worklist.addTo(stats);
+          pthread_mutex_unlock(&q.lock);
+        }
+
+        // iterates the blocks of component c until they stop changing
+        void solveComponent(unsigned c, Worklist &q, Set scratch) {
+          for (unsigned i = componentStart[c]; i < componentStart[c + 1]; i++) {
+            q.push(componentBlocks[i]);
+          }
+          while (!q.empty()) {
+            if (forward) {
+              reversePostOrder(q, scratch, c);
+            } else {
+              postOrder(q, scratch, c);
+            }
+          }
+        }
+
+        // block summary rows, only there if hasBlockSummaries()
+        Set gen(unsigned b) { return sets.row(rowsPerBlock * b + 2); }
+        Set kill(unsigned b) { return sets.row(rowsPerBlock * b + 3); }
+
+        // the spare row of solver thread w, free for transfer to use
+        Set scratch(unsigned w) { return sets.row(rowsPerBlock * order.size() + w); }
+
+        /* the block transfer used while iterating: word-wise gen/kill if the
+         * analysis summarizes its blocks, the full transfer otherwise */
+        bool applyTransfer(unsigned b, Set scratch) {
+          if (rowsPerBlock == 4) {
+            if (forward)
+              return (*out)[b].assignGenKill(gen(b), (*in)[b], kill(b));
+            else
+              return (*in)[b].assignGenKill(gen(b), (*out)[b], kill(b));
+          }
+          return derived().transfer(*order[b], scratch);
+        }
+
+        // the default block transfer, see Dataflow::transfer
+        bool transfer(BasicBlock& bb, Set cur) {
+          if (forward) {
+            cur.copy((*in)[&bb]);
+            derived().enterBlock(bb, cur);
+            for (BasicBlock::iterator ii = bb.begin(), ie = bb.end(); ii != ie; ++ii)
+              derived().transferInstruction(*ii, cur);
+            return (*out)[&bb].assign(cur);
+          } else {
+            cur.copy((*out)[&bb]);
+            derived().enterBlock(bb, cur);
+            for (BasicBlock::iterator ii = bb.end(), ib = bb.begin(); ii != ib; ) {
+              --ii;
+              derived().transferInstruction(*ii, cur);
+            }
+            return (*in)[&bb].assign(cur);
+          }
+        }
+
+        /* Per-instruction sets are not stored. setBefore/setAfter rebuild the
+         * set at a program point from the nearest block boundary, and the
+         * results for the last few blocks asked about are kept in points.
+         * The returned set is only good until the next query. */
+        Set setBefore(Instruction *I) { return pointSet(I, true); }
+        Set setAfter(Instruction *I) { return pointSet(I, false); }
+
+        /* the sets at the program points of one block: point j is just
+         * before the block's j'th instruction, point k (its length) after
+         * the last. rows holds every step'th point and point k, one row
+         * each; step is 1 unless the block is longer than
+         * MAX_CACHED_POINTS. The points in between are filled in a segment
+         * (from one of those rows to the next) at a time, when asked for. */
+        struct BlockPoints {
+          BlockPoints() : bb(NULL), step(1), first(0), length(0), segment(NO_SEGMENT) {}
+          BasicBlock *bb;
+          unsigned step;
+          Storage rows;
+          // holds rows, reset whenever the entry is reused
+          Arena arena;
+          /* instruction j is at position first + j of the analysis'
+           * numbering if it has one, else insts[j], found by pos */
+          unsigned first;
+          unsigned length;
+          DenseMap<Instruction*, unsigned> pos;
+          std::vector<Instruction*> insts;
+          // the points from segment * step on, and the arena they come from
+          unsigned segment;
+          Storage segmentRows;
+          Arena segmentArena;
+        };
+
+        enum { NO_SEGMENT = ~0u };
+
+        // small round-robin cache of blocks
+        enum { CACHED_BLOCKS = 4 };
+        BlockPoints points[CACHED_BLOCKS];
+        unsigned nextPoints;
+
+        // one row of pointBits(), the running set while a block is cached
+        Storage walk;
+
+        // where sets and walk get their rows, reset for every function
+        Arena arena;
+
+        // rows kept per cached block, segment aside, so memory stays bounded
+        // by the number of blocks rather than the number of instructions
+        enum { MAX_CACHED_POINTS = 1024 };
+
+        // empties the cache; with release, the arenas give their memory back too
+        void clearPoints(bool release = false) {
+          for (unsigned i = 0; i < CACHED_BLOCKS; i++) {
+            points[i].bb = NULL;
+            points[i].length = 0;
+            points[i].rows.clear();
+            points[i].pos.clear();
+            trim(points[i].insts);
+            points[i].segment = NO_SEGMENT;
+            points[i].segmentRows.clear();
+            if (release) {
+              points[i].arena.release();
+              points[i].segmentArena.release();
+            } else {
+              points[i].arena.reset();
+              points[i].segmentArena.reset();
+            }
+          }
+        }
+
+        /* One query costs at most a segment's worth of transfers, and a
+         * block's queries together about two transfers per instruction. */
+        Set pointSet(Instruction *I, bool before) {
+          BlockPoints &p = cachedPoints(I->getParent());
+          const ValueNumbering *numbering = derived().instructionNumbering();
+          unsigned j = (numbering ? numbering->position(I) - p.first : p.pos[I]) + (before ? 0 : 1);
+          unsigned k = p.length;
+          if (j % p.step == 0 || j == k) return p.rows.row(checkpoint(p, j));
+
+          unsigned t = j / p.step;
+          if (p.segment != t) fillSegment(p, t);
+          return p.segmentRows.row(j - t * p.step);
+        }
+
+        // the row of rows holding point j, which is a multiple of step or the last
+        unsigned checkpoint(const BlockPoints &p, unsigned j) const {
+          unsigned k = p.length;
+          return j == k ? (k + p.step - 1) / p.step : j / p.step;
+        }
+
+        // turns cur, the set at the block boundary of I's block, into the set before or after I
+        void walkTo(Instruction *I, bool before, Set cur) {
+          BasicBlock *bb = I->getParent();
+          derived().enterBlock(*bb, cur);
+          if (const ValueNumbering *numbering = derived().instructionNumbering()) {
+            // through I if after it (before it if backward), by position
+            std::pair<unsigned, unsigned> range = numbering->block(bb);
+            unsigned stop = numbering->position(I) + (before ? 0 : 1);
+            if (forward) {
+              for (unsigned p = range.first; p < stop; p++)
+                derived().transferAt(p, cur);
+            } else {
+              for (unsigned p = range.second; p-- > stop; )
+                derived().transferAt(p, cur);
+            }
+          } else if (forward) {
+            for (BasicBlock::iterator ii = bb->begin(); ; ++ii) {
+              if (&*ii == I && before) break;
+              derived().transferInstruction(*ii, cur);
+              if (&*ii == I) break;
+            }
+          } else {
+            for (BasicBlock::iterator ii = bb->end(); ; ) {
+              --ii;
+              if (&*ii == I && !before) break;
+              derived().transferInstruction(*ii, cur);
+              if (&*ii == I) break;
+            }
+          }
+        }
+
+        // fills a cache entry with the rows of bb, unless it's already there
+        BlockPoints &cachedPoints(BasicBlock *bb) {
+          for (unsigned i = 0; i < CACHED_BLOCKS; i++) {
+            if (points[i].bb == bb) return points[i];
+          }
+
+          BlockPoints &p = points[nextPoints];
+          nextPoints = (nextPoints + 1) % CACHED_BLOCKS;
+          p.bb = bb;
+          p.pos.clear();
+          p.insts.clear();
+          if (const ValueNumbering *numbering = derived().instructionNumbering()) {
+            std::pair<unsigned, unsigned> range = numbering->block(bb);
+            p.first = range.first;
+            p.length = range.second - range.first;
+          } else {
+            for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+              p.pos[&*ii] = p.insts.size();
+              p.insts.push_back(&*ii);
+            }
+            p.first = 0;
+            p.length = p.insts.size();
+          }
+          unsigned k = p.length;
+          p.step = std::max(1u, (k + MAX_CACHED_POINTS - 1) / MAX_CACHED_POINTS);
+          p.segment = NO_SEGMENT;
+          p.arena.reset();
+          p.rows.resize(checkpoint(p, k) + 1, pointBits(), p.arena);
+
+          // one walk over the block, keeping the points that get a row
+          Set cur = walk.row(0);
+          if (forward) {
+            cur.load((*in)[bb]);
+            derived().enterBlock(*bb, cur);
+            for (unsigned j = 0; ; j++) {
+              if (j % p.step == 0 || j == k) p.rows.row(checkpoint(p, j)).copy(cur);
+              if (j == k) break;
+              transferPoint(p, j, cur);
+            }
+          } else {
+            cur.load((*out)[bb]);
+            derived().enterBlock(*bb, cur);
+            for (unsigned j = k; ; j--) {
+              if (j % p.step == 0 || j == k) p.rows.row(checkpoint(p, j)).copy(cur);
+              if (j == 0) break;
+              transferPoint(p, j - 1, cur);
+            }
+          }
+          return p;
+        }
+
+        // instruction j of p's block applied to cur; insts is only filled without a numbering
+        void transferPoint(const BlockPoints &p, unsigned j, Set cur) {
+          if (p.insts.empty()) derived().transferAt(p.first + j, cur);
+          else derived().transferInstruction(*p.insts[j], cur);
+        }
+
+        // every point of segment t, from the row at the end the flow enters it
+        void fillSegment(BlockPoints &p, unsigned t) {
+          unsigned first = t * p.step;
+          unsigned last = std::min(first + p.step, p.length);
+          p.segment = t;
+          p.segmentArena.reset();
+          p.segmentRows.resize(last - first + 1, pointBits(), p.segmentArena);
+          if (forward) {
+            p.segmentRows.row(0).copy(p.rows.row(checkpoint(p, first)));
+            for (unsigned j = first; j < last; j++) {
+              Set next = p.segmentRows.row(j - first + 1);
+              next.copy(p.segmentRows.row(j - first));
+              transferPoint(p, j, next);
+            }
+          } else {
+            p.segmentRows.row(last - first).copy(p.rows.row(checkpoint(p, last)));
+            for (unsigned j = last; j-- > first; ) {
+              Set prev = p.segmentRows.row(j - first);
+              prev.copy(p.segmentRows.row(j - first + 1));
+              transferPoint(p, j, prev);
+            }
+          }
+        }
+
+        /* Demand-driven queries: whether one bit is in the set at one point,
+         * without solving the function. Call prepareQueries instead of
+         * runOnFunction, then ask. A query walks back against the flow from
+         * its point only until it finds a block that settles the answer,
+         * summarizing each block it passes (once, with the analysis' own
+         * transferInstruction), and remembers what it learns for later
+         * queries.
+         *
+         * This needs a problem where every bit flows on its own (the gen/kill
+         * kind hasBlockSummaries describes), meetOp() MEET_UNION or
+         * MEET_INTERSECTION, and initialInteriorPoint giving the meet's
+         * identity, none for union and all for intersection. Every analysis
+         * here but faint variables is like that. The answers are then those
+         * of runOnFunction. */
+        void prepareQueries(Function &f) {
+          stats.clear();
+          stats.function = f.getName().str();
+          stats.storage = Storage::name();
+          computeOrder(f);
+          clearPoints();
+          unsigned n = order.size();
+          arena.reset();
+          sets.clear();
+          walk.clear();
+          queryRows.resize(2, pointBits(), arena);
+          derived().getBoundaryCondition(queryRows.row(0));
+          summaries.assign(n, Storage());
+          summarized.assign(n, false);
+          answers.clear();
+          seen.assign(n, 0);
+          cameFrom.assign(n, 0);
+          queryStamp = 0;
+          stats.blocks = n;
+          stats.values = pointBits();
+        }
+
+        bool queryIn(BasicBlock *bb, unsigned bit) {
+          unsigned b = number[bb];
+          return forward ? queryBoundary(b, bit) : throughBlock(b, bit, queryBoundary(b, bit));
+        }
+
+        bool queryOut(BasicBlock *bb, unsigned bit) {
+          unsigned b = number[bb];
+          return forward ? throughBlock(b, bit, queryBoundary(b, bit)) : queryBoundary(b, bit);
+        }
+
+        bool queryBefore(Instruction *I, unsigned bit) { return queryPoint(I, bit, true); }
+        bool queryAfter(Instruction *I, unsigned bit) { return queryPoint(I, bit, false); }
+
+        // row 0 is the boundary condition, row 1 is for walking a block
+        Storage queryRows;
+
+        // per block, rows for its transfer of the empty and the full set, made when first needed
+        std::vector<Storage> summaries;
+        std::vector<bool> summarized;
+
+        // (bit, block) -> the bit in in[b] (out[b] if backward), as found by earlier queries
+        DenseMap<std::pair<unsigned, unsigned>, bool> answers;
+
+        // the blocks a query has been through: seen[b] == queryStamp, and the block it came from
+        std::vector<unsigned> seen, cameFrom, visited;
+        unsigned queryStamp;
+
+        // blocks whose result flows into block b
+        unsigned feedBegin(unsigned b) const { return forward ? predStart[b] : succStart[b]; }
+        unsigned feedEnd(unsigned b) const { return forward ? predStart[b + 1] : succStart[b + 1]; }
+        unsigned feeder(unsigned e) const { return forward ? preds[e] : succs[e]; }
+
+        bool queryPoint(Instruction *I, unsigned bit, bool before) {
+          unsigned b = number[I->getParent()];
+          Set cur = queryRows.row(1);
+          cur.reset();
+          if (queryBoundary(b, bit)) cur.set(bit);
+          walkTo(I, before, cur);
+          return cur[bit];
+        }
+
+        // what the block does to the bit: 0 or 1 whatever comes in, or 2 to pass it through
+        unsigned blockEffect(unsigned b, unsigned bit) {
+          if (!summarized[b]) {
+            summarized[b] = true;
+            summaries[b].resize(2, pointBits(), arena);
+            Set none = summaries[b].row(0), all = summaries[b].row(1);
+            all.set();
+            walkBlock(*order[b], none);
+            walkBlock(*order[b], all);
+            stats.transfers += 2;
+          }
+          bool none = summaries[b].row(0)[bit], all = summaries[b].row(1)[bit];
+          return none == all ? none : 2;
+        }
+
+        bool throughBlock(unsigned b, unsigned bit, bool value) {
+          if (bit >= width) return false;
+          unsigned effect = blockEffect(b, bit);
+          return effect == 2 ? value : effect;
+        }
+
+        // transferInstruction over the whole block, in the direction of the analysis
+        void walkBlock(BasicBlock &bb, Set cur) {
+          derived().enterBlock(bb, cur);
+          if (const ValueNumbering *numbering = derived().instructionNumbering()) {
+            std::pair<unsigned, unsigned> range = numbering->block(&bb);
+            if (forward) {
+              for (unsigned p = range.first; p < range.second; p++)
+                derived().transferAt(p, cur);
+            } else {
+              for (unsigned p = range.second; p-- > range.first; )
+                derived().transferAt(p, cur);
+            }
+          } else if (forward) {
+            for (BasicBlock::iterator ii = bb.begin(), ie = bb.end(); ii != ie; ++ii)
+              derived().transferInstruction(*ii, cur);
+          } else {
+            for (BasicBlock::iterator ii = bb.end(), ib = bb.begin(); ii != ib; ) {
+              --ii;
+              derived().transferInstruction(*ii, cur);
+            }
+          }
+        }
+
+        /* the bit in in[b] (out[b] if backward). With a union meet it is set
+         * if some block feeding b sets it, or passes it on from one that
+         * does; with intersection it is clear if some block clears it. So
+         * this searches back from b for such a block, and gives up (the
+         * other answer) once everything it can get to is exhausted. */
+        bool queryBoundary(unsigned b, unsigned bit) {
+          // boundary sets stop at width, the rest never leave their block
+          if (bit >= width) return false;
+          DenseMap<std::pair<unsigned, unsigned>, bool>::iterator known = answers.find(std::make_pair(bit, b));
+          if (known != answers.end()) return known->second;
+
+          bool sought = derived().meetOp() == MEET_UNION;
+          const unsigned NONE = ~0u;
+          if (++queryStamp == 0) {
+            std::fill(seen.begin(), seen.end(), 0);
+            queryStamp = 1;
+          }
+          visited.clear();
+          visited.push_back(b);
+          seen[b] = queryStamp;
+          cameFrom[b] = NONE;
+          unsigned found = NONE;
+
+          for (unsigned next = 0; next < visited.size() && found == NONE; next++) {
+            unsigned x = visited[next];
+            if (feedBegin(x) == feedEnd(x)) {
+              // the boundary condition at the entry, numbered 0 (at the exits if backward), a cleared set elsewhere
+              bool value = (!forward || x == 0) && queryRows.row(0)[bit];
+              if (value == sought) found = x;
+              continue;
+            }
+            for (unsigned e = feedBegin(x); e != feedEnd(x) && found == NONE; e++) {
+              unsigned p = feeder(e);
+              unsigned effect = blockEffect(p, bit);
+              if (effect != 2) {
+                if ((effect == 1) == sought) found = x;
+                continue;
+              }
+              known = answers.find(std::make_pair(bit, p));
+              if (known != answers.end()) {
+                if (known->second == sought) found = x;
+                continue;
+              }
+              if (seen[p] != queryStamp) {
+                seen[p] = queryStamp;
+                cameFrom[p] = x;
+                visited.push_back(p);
+              }
+            }
+          }
+
+          if (found == NONE) {
+            // nothing gets to any block the search went through
+            for (unsigned i = 0; i < visited.size(); i++)
+              answers[std::make_pair(bit, visited[i])] = !sought;
+            return !sought;
+          }
+          // and everything between found and b passes it on
+          for (unsigned x = found; x != NONE; x = cameFrom[x])
+            answers[std::make_pair(bit, x)] = sought;
+          return sought;
+        }
+
+        // defaults for the optional hooks, see Dataflow
+        MeetOp meetOp() { return MEET_CUSTOM; }
+        void enterBlock(BasicBlock&, Set) {}
+        bool hasBlockSummaries() { return false; }
+        void getBlockSummary(BasicBlock&, Set, Set) {}
+        bool solveDirectly(Function&) { return false; }
+        void blockChanged(BasicBlock&) {}
+        void erasing(Instruction&) {}
+        void replacing(Value*, Value*) {}
+        const ValueNumbering *instructionNumbering() { return NULL; }
+        void transferAt(unsigned, Set) {}
     };
-}
 
+    /* The solver with every hook a virtual function, for analyses that
+     * don't need the last bit of speed. */
+    template<bool forward, class Storage = DenseMatrix>
+    struct Dataflow : public DataflowSolver<Dataflow<forward, Storage>, forward, Storage>
+    {
+        typedef DataflowSolver<Dataflow<forward, Storage>, forward, Storage> Solver;
+        typedef typename Solver::Set Set;
+
+        virtual ~Dataflow() {}
+
+        virtual bool runOnFunction(Function &f) { return Solver::runOnFunction(f); }
+
+        /* applies the block's transfer function, writing the result straight
+         * into out[b] (in[b] for backward problems). Returns true if that set
+         * changed. scratch is a set the transfer may use as it likes. By
+         * default this runs transferInstruction over the block. */
+        virtual bool transfer(BasicBlock& bb, Set scratch) { return Solver::transfer(bb, scratch); }
+
+        virtual void getBoundaryCondition(Set) = 0;
+        virtual void meet(Set, Set) = 0;
+        virtual void initialInteriorPoint(BasicBlock&, Set) = 0;
+
+        /* MEET_UNION or MEET_INTERSECTION if that is all meet does. The
+         * solver then merges every predecessor (successor if backward) of a
+         * block in a single pass instead of one meet call each. */
+        virtual MeetOp meetOp() { return MEET_CUSTOM; }
+
+        /* applies a single instruction to the set, in the direction of the
+         * analysis: the set after I becomes the set before I if backward. */
+        virtual void transferInstruction(Instruction&, Set) = 0;
+
+        /* any adjustment made at the block boundary (in[b] for forward
+         * problems, out[b] for backward ones) before its instructions are
+         * applied. Nothing by default. */
+        virtual void enterBlock(BasicBlock&, Set) {}
+
+        /* Analyses whose block transfer has the form
+         *   out = gen | (in & ~kill)    (in = gen | (out & ~kill) if backward)
+         * can return true here and fill in gen and kill for each block. The
+         * fixed point is then found with word operations only, and
+         * transferInstruction only runs to answer setBefore/setAfter. */
+        virtual bool hasBlockSummaries() { return false; }
+        virtual void getBlockSummary(BasicBlock&, Set gen, Set kill) {}
+
+        /* An analysis that can work out the fixed point without iterating
+         * (say liveness in SSA form, from the def-use chains) writes it into
+         * in and out here and returns true; the worklist is then skipped.
+         * in and out hold the initial sets and the boundary condition when
+         * it is called. No by default. */
+        virtual bool solveDirectly(Function&) { return false; }
+
+        /* called by update() for each block reported changed, before it is
+         * summarized or walked again: where the analysis refreshes whatever
+         * it keeps per instruction. Nothing by default. */
+        virtual void blockChanged(BasicBlock&) {}
+
+        /* called by instructionErased while I is still there, to drop
+         * anything keyed by it. Nothing by default. */
+        virtual void erasing(Instruction&) {}
+
+        /* called by usesReplaced before from's uses become to's. Nothing by
+         * default. */
+        virtual void replacing(Value*, Value*) {}
+
+        /* An analysis that lays its instructions out in a ValueNumbering can
+         * return it here and implement transferAt, transferInstruction for
+         * the instruction at position p. The walks that rebuild the sets at
+         * program points then go through each block's positions instead of
+         * looking every instruction up. NULL by default. */
+        virtual const ValueNumbering *instructionNumbering() { return NULL; }
+        virtual void transferAt(unsigned p, Set) {}
+    };
+
+    // [lo, hi) of indices a worker has left, thieves take from the top
+    struct WorkRange {
+      WorkRange() : lo(0), hi(0) { pthread_mutex_init(&lock, NULL); }
+      ~WorkRange() { pthread_mutex_destroy(&lock); }
+
+      pthread_mutex_t lock;
+      unsigned lo, hi;
+    };
+
+    /* The thread pool behind parallelFor. Every worker starts on an equal
+     * slice of the indices; once its own slice is used up it takes the top
+     * half of whatever another worker has left. */
+    template<class Body>
+    struct WorkPool {
+      WorkPool(Body &b, unsigned n, unsigned threads) : body(b), numThreads(threads) {
+        ranges = new WorkRange[threads];
+        for (unsigned w = 0; w < threads; w++) {
+          ranges[w].lo = (unsigned)((uint64_t)n * w / threads);
+          ranges[w].hi = (unsigned)((uint64_t)n * (w + 1) / threads);
+        }
+      }
+
+      ~WorkPool() { delete[] ranges; }
+
+      Body &body;
+      unsigned numThreads;
+      WorkRange *ranges;
+
+      // argument of the pthread entry point
+      struct Worker {
+        WorkPool *pool;
+        unsigned id;
+      };
+
+      static void *start(void *arg) {
+        Worker *w = static_cast<Worker*>(arg);
+        w->pool->work(w->id);
+        return NULL;
+      }
+
+      void run() {
+        std::vector<Worker> workers(numThreads);
+        std::vector<pthread_t> threads(numThreads);
+        for (unsigned w = 0; w < numThreads; w++) {
+          workers[w].pool = this;
+          workers[w].id = w;
+        }
+
+        /* the calling thread is worker 0. If a thread can't be started the
+         * others steal its slice, since nobody stops while work is left. */
+        unsigned started = 1;
+        for (unsigned w = 1; w < numThreads; w++, started++) {
+          if (pthread_create(&threads[w], NULL, start, &workers[w]) != 0)
+            break;
+        }
+        work(0);
+        for (unsigned w = 1; w < started; w++) {
+          pthread_join(threads[w], NULL);
+        }
+      }
+
+      void work(unsigned w) {
+        unsigned i;
+        while (next(w, i)) {
+          body(i, w);
+        }
+      }
+
+      // the next index for worker w, false once no worker has any left
+      bool next(unsigned w, unsigned &i) {
+        WorkRange &own = ranges[w];
+        pthread_mutex_lock(&own.lock);
+        bool found = own.lo < own.hi;
+        if (found) i = own.lo++;
+        pthread_mutex_unlock(&own.lock);
+        if (found) return true;
+
+        for (unsigned k = 1; k < numThreads; k++) {
+          WorkRange &victim = ranges[(w + k) % numThreads];
+          unsigned lo = 0, hi = 0;
+          pthread_mutex_lock(&victim.lock);
+          if (victim.lo < victim.hi) {
+            lo = victim.lo + (victim.hi - victim.lo) / 2;
+            hi = victim.hi;
+            victim.hi = lo;
+          }
+          pthread_mutex_unlock(&victim.lock);
+
+          if (lo < hi) {
+            i = lo;
+            pthread_mutex_lock(&own.lock);
+            own.lo = lo + 1;
+            own.hi = hi;
+            pthread_mutex_unlock(&own.lock);
+            return true;
+          }
+        }
+        return false;
+      }
+    };
+
+    /* Calls body(i, w) for every i in [0, n) from up to `threads` threads,
+     * in no particular order. w < threads numbers the calling worker, so body
+     * can keep scratch state (an analysis instance, say) per worker. */
+    template<class Body>
+    void parallelFor(unsigned n, unsigned threads, Body &body) {
+      if (threads > n) threads = n;
+      if (threads <= 1) {
+        for (unsigned i = 0; i < n; i++) body(i, 0);
+        return;
+      }
+      WorkPool<Body> pool(body, n, threads);
+      pool.run();
+    }
+
+    // the number of worker threads to use when asked for `requested`, 0 meaning one per core
+    inline unsigned workerCount(unsigned requested) {
+      if (requested) return requested;
+      long cores = sysconf(_SC_NPROCESSORS_ONLN);
+      return cores > 0 ? (unsigned)cores : 1;
+    }
+
+    // the functions of M that have a body, in module order
+    inline void definedFunctions(Module &M, std::vector<Function*> &funcs) {
+      for (Module::iterator fi = M.begin(), fe = M.end(); fi != fe; ++fi) {
+        if (!fi->isDeclaration()) funcs.push_back(&*fi);
+      }
+    }
+
+    // parallelFor body of runParallel: function i prints into text[i]
+    template<class Runner>
+    struct PrintJob {
+      std::vector<Function*> *funcs;
+      std::vector<std::string> *text;
+      std::vector<SolverStats> *stats;
+      std::vector<Runner*> *runners;
+
+      void operator()(unsigned i, unsigned w) {
+        raw_string_ostream os((*text)[i]);
+        (*runners)[w]->run(*(*funcs)[i], os);
+        os.flush();
+        (*stats)[i] = (*runners)[w]->stats;
+        (*runners)[w]->releaseMemory();
+      }
+    };
+
+    /* Calls Runner::run(F, os) for every function in M from `threads`
+     * threads (see workerCount), each with a Runner of its own. What each
+     * function prints is collected and written to out in module order, so
+     * the output doesn't depend on the schedule; Runner::stats for each
+     * function ends up in stats, also in module order. */
+    template<class Runner>
+    void runParallel(Module &M, unsigned threads, raw_ostream &out, std::vector<SolverStats> &stats) {
+      std::vector<Function*> funcs;
+      definedFunctions(M, funcs);
+      threads = std::min(workerCount(threads), (unsigned)funcs.size());
+
+      std::vector<Runner*> runners;
+      for (unsigned w = 0; w < threads; w++) {
+        runners.push_back(new Runner());
+      }
+
+      std::vector<std::string> text(funcs.size());
+      stats.assign(funcs.size(), SolverStats());
+      PrintJob<Runner> job = { &funcs, &text, &stats, &runners };
+      parallelFor(funcs.size(), threads, job);
+
+      for (unsigned i = 0; i < text.size(); i++) {
+        out << text[i];
+      }
+      for (unsigned w = 0; w < threads; w++) {
+        delete runners[w];
+      }
+    }
+
+    /* Writes one record per function to file: CSV if its name ends in
+     * .csv, JSON otherwise, and "-" for stderr. */
+    inline void writeStats(const std::string &file, const char *pass, const std::vector<SolverStats> &all) {
+      bool csv = file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0;
+      std::string text;
+      raw_string_ostream os(text);
+
+      if (csv) {
+        os << "pass,function,storage,blocks,values,components,pushes,pops,transfers,meets,iterations,set_bytes";
+        for (unsigned p = 0; p < NUM_PHASES; p++) os << ",time_" << phaseName(p);
+        os << "\n";
+      } else {
+        os << "[\n";
+      }
+
+      for (unsigned i = 0; i < all.size(); i++) {
+        const SolverStats &st = all[i];
+        if (csv) {
+          // quotes inside a quoted CSV field are doubled
+          std::string name;
+          for (unsigned c = 0; c < st.function.size(); c++) {
+            if (st.function[c] == '"') name += '"';
+            name += st.function[c];
+          }
+          os << pass << ",\"" << name << "\"," << st.storage << "," << st.blocks << ","
+             << st.values << "," << st.components << "," << st.pushes << "," << st.pops << ","
+             << st.transfers << "," << st.meets << "," << st.iterations << "," << st.setBytes;
+          for (unsigned p = 0; p < NUM_PHASES; p++) os << "," << st.time[p];
+          os << "\n";
+        } else {
+          os << "  {\"pass\": \"" << pass << "\", \"function\": \"" << jsonEscape(st.function)
+             << "\", \"storage\": \"" << st.storage << "\", \"blocks\": " << st.blocks
+             << ", \"values\": " << st.values << ", \"components\": " << st.components
+             << ", \"pushes\": " << st.pushes << ", \"pops\": " << st.pops
+             << ", \"transfers\": " << st.transfers << ", \"meets\": " << st.meets
+             << ", \"iterations\": " << st.iterations << ", \"set_bytes\": " << st.setBytes;
+          for (unsigned p = 0; p < NUM_PHASES; p++) os << ", \"time_" << phaseName(p) << "\": " << st.time[p];
+          os << "}" << (i + 1 < all.size() ? "," : "") << "\n";
+        }
+      }
+      if (!csv) os << "]\n";
+      os.flush();
+
+      if (file == "-") {
+        errs() << text;
+        return;
+      }
+      std::ofstream out(file.c_str());
+      if (!out) {
+        errs() << "can't write " << file << "\n";
+        return;
+      }
+      out << text;
+    }
+}
@@ -11,209 +11,631 @@
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/ADT/BitVector.h"
-#include "llvm/ADT/ValueMap.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Support/CFG.h"
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Assembly/Writer.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "dataflow.cpp"
+#include "ssaliveness.cpp"
 
 #include <ostream>
+#include <string>
 
 using namespace llvm;
 
 namespace
 {
-    struct Liveness : public Dataflow<false>, public FunctionPass
+    static cl::opt<bool> LivenessPrune("liveness-prune",
+        cl::desc("Only solve -Liveness for values used outside their own block"), cl::init(true));
+
+    /* One walk per value costs the blocks it is live in, which is more than
+     * the bit-vector solver once many values are live across much of the
+     * function. Kept for comparison, not as a faster mode. */
+    static cl::opt<bool> LivenessSSA("liveness-ssa", cl::Hidden,
+        cl::desc("Find -Liveness from the def-use chains of each value instead of iterating"), cl::init(false));
+
+    static cl::opt<std::string> LivenessQuery("liveness-query",
+        cl::desc("Only ask whether this value (named without the %) is live at each point, on demand instead of solving"));
+
+    static cl::opt<bool> LivenessPrint("liveness-print",
+        cl::desc("Print the live values at each program point"), cl::init(true));
+
+    static cl::opt<unsigned> LivenessSCC("liveness-scc",
+        cl::desc("Solve -Liveness by CFG strongly connected component on this many threads, 0 for one worklist"), cl::init(0));
+
+    // the analysis itself, over any set representation
+    template<class Storage>
+    struct LivenessAnalysis : public DataflowSolver<LivenessAnalysis<Storage>, false, Storage>
     {
-        static char ID;
+        typedef DataflowSolver<LivenessAnalysis<Storage>, false, Storage> Base;
+        typedef typename Base::Set Set;
+        using Base::in;
+        using Base::out;
+        using Base::width;
+        using Base::sccThreads;
+        using Base::stats;
+        using Base::pointWidth;
+        using Base::setBefore;
 
-        Liveness() : Dataflow<false>(), FunctionPass(ID) {
-          index = new ValueMap<Value*, int>();
-          r_index = new std::vector<Value*>();
-          instIn = new ValueMap<Instruction*, BitVector*>();
+        LivenessAnalysis() : Base() {
+          os = &errs();
         }
 
-        // map from instructions/argument to their index in the bitvector
-        ValueMap<Value*, int> *index;
-        
-        // map from index in bitvector back to instruction/argument
-        std::vector<Value*> *r_index;
+        // bit numbers of the arguments and definitions, and back
+        ValueNumbering numbering;
+
+        // where displayResults prints
+        raw_ostream *os;
         
         // convenience
         int numTotal;
         int numArgs;
 
-        // map from instructions to bitvector corresponding to program point BEFORE that instruction
-        ValueMap<Instruction*, BitVector*> *instIn;
+        /* values with bits below this can be live at a block boundary. With
+         * -liveness-prune the rest are definitions whose uses are all in
+         * their own block: they only show up in setBefore, which finds them
+         * by walking the block, and in[b]/out[b] are only numCrossing wide. */
+        int numCrossing;
+
+        // bits in the order values are printed: arguments, then definitions
+        std::vector<int> displayOrder;
+
+        // for -liveness-ssa
+        SSALiveness ssa;
 
-        virtual void meet(BitVector *op1, const BitVector *op2) {
+        // bit of the -liveness-query value, NONE to print whole sets
+        unsigned queryBit;
+
+        void meet(Set op1, Set op2) {
           // union
-          *op1 |= *op2;
+          op1 |= op2;
         }
 
-        virtual void getBoundaryCondition(BitVector *entry) {
+        MeetOp meetOp() { return MEET_UNION; }
+
+        void getBoundaryCondition(Set entry) {
           // out[b] = empty set if no successors
-          *entry = BitVector(numTotal, false);
+          entry.reset();
         }
         
-        bool isDefinition(Instruction *ii) {
+        // true if v has a use outside bb, or feeds a phi
+        static bool usedOutside(Value *v, BasicBlock *bb) {
+          for (Value::use_iterator UI = v->use_begin(), UE = v->use_end(); UI != UE; ++UI) {
+            Instruction *user = dyn_cast<Instruction>(*UI);
+            if (user && (user->getParent() != bb || isa<PHINode>(user)))
+              return true;
+          }
+          return false;
+        }
+
+        // the number of blocks v is defined (in bb) or used in
+        static unsigned blocksTouched(Value *v, BasicBlock *bb) {
+          SmallPtrSet<BasicBlock*, 16> blocks;
+          blocks.insert(bb);
+          for (Value::use_iterator UI = v->use_begin(), UE = v->use_end(); UI != UE; ++UI) {
+            Instruction *user = dyn_cast<Instruction>(*UI);
+            if (user && !blocks.count(user->getParent())) blocks.insert(user->getParent());
+          }
+          return blocks.size();
+        }
+
+        static bool isDefinition(Instruction *ii) {
           return (!(isa<TerminatorInst>(ii) || isa<StoreInst>(ii) || (isa<CallInst>(ii) && cast<CallInst>(ii)->getCalledFunction()->getReturnType()->isVoidTy())));
         }
 
-        BitVector* initialInteriorPoint(BasicBlock& bb) {
+        void initialInteriorPoint(BasicBlock& bb, Set init) {
           // in[b] = empty set initially
-          return new BitVector(numTotal, false);
+          init.reset();
         }
 
-        virtual bool runOnFunction(Function &F) {
+        // everything kept for the last function, after the solver's own
+        void releaseMemory() {
+          Base::releaseMemory();
+          numbering.clear();
+          trim(displayOrder);
+          ssa.releaseMemory();
+          recheck.clear();
+        }
+
+        bool runOnFunction(Function &F) {
+          if (!analyze(F)) return false;
+         
+          // print out instructions with reaching variables between each instruction 
+          double start = wallTime();
+          traceBegin("output", F);
+          if (LivenessPrint) displayResults(F);
+          stats.time[PHASE_OUTPUT] = wallTime() - start;
+          traceEnd("output", F);
+          
+          // didn't modify nothing 
+          return false;
+        }
+
+        // numbers F's values and solves, or gets ready for the query; false if F doesn't have it
+        bool analyze(Function &F) {
+          double start = wallTime();
+          traceBegin("index", F);
           numTotal = 0;
           numArgs = 0;
+          numbering.clear();
+          displayOrder.clear();
           
-          // add function arguments to maps
+          // add function arguments to maps, they are live into the entry block
           for (Function::arg_iterator ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++) {
-            (*index)[&*ai] = numArgs;
-            r_index->push_back(&*ai);
+            addValue(&*ai);
             numArgs++;
           }
-          numTotal = numArgs; 
           
-          // add definitions to maps
+          // add definitions to maps, those that stay inside their block last
           for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
-            if (isDefinition(&*ii)) {
-              (*index)[&*ii] = numTotal;
-              r_index->push_back(&*ii);
-              numTotal++;
-            }
+            if (isDefinition(&*ii) && (!LivenessPrune || usedOutside(&*ii, ii->getParent())))
+              addValue(&*ii);
           }
-          
-          // initialize instIn
+          numCrossing = numTotal;
           for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
-            (*instIn)[&*ii] = new BitVector(numTotal, false);
+            if (isDefinition(&*ii) && LivenessPrune && !usedOutside(&*ii, ii->getParent()))
+              addValue(&*ii);
+          }
+          numbering.index(F);
+
+          for (int i = 0; i < numArgs; i++)
+            displayOrder.push_back(i);
+          for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
+            if (isDefinition(&*ii))
+              displayOrder.push_back(numbering.lookup(&*ii));
           }
-          top = new BitVector(numTotal, false);
           
-          // run data flow 
-          Dataflow<false>::runOnFunction(F);
-         
-          // print out instructions with reaching variables between each instruction 
-          displayResults(F);
+          width = numCrossing;
+          pointWidth = numTotal;
+          sccThreads = LivenessSCC;
           
-          // didn't modify nothing 
-          return false;
+          queryBit = ValueNumbering::NONE;
+          if (!LivenessQuery.empty()) {
+            for (int i = 0; i < numTotal; i++) {
+              if (numbering.value(i)->getName() == LivenessQuery) queryBit = i;
+            }
+            // nothing to ask in a function without it, nor to count
+            if (queryBit == ValueNumbering::NONE) {
+              stats.clear();
+              stats.function = F.getName().str();
+              stats.storage = Storage::name();
+              return false;
+            }
+          }
+
+          // run data flow, or get ready to answer queries
+          double indexTime = wallTime() - start;
+          traceEnd("index", F);
+          if (queryBit != ValueNumbering::NONE) {
+            Base::prepareQueries(F);
+          } else {
+            Base::runOnFunction(F);
+          }
+          stats.time[PHASE_INDEX] = indexTime;
+          return true;
         }
         
-        virtual BitVector* transfer(BasicBlock& bb) {
-          // we iterate over instructions in reverse beginning with out[bb]
-          BitVector* next = new BitVector(*((*out)[&bb]));
-          
-          // temporary variables for convenience
-          BitVector* instVec = next; // for empty blocks
-          Instruction* inst;
+        void addValue(Value *v) {
+          numbering.add(v);
+          numTotal++;
+        }
 
-          // add local phi-captured nodes to out          
-          for (BasicBlock::iterator ii = bb.begin(), ib = bb.end(); ii != ib; ++ii) {
-            if (isa<PHINode>(*ii)) {
-              PHINode* phiInst = cast<PHINode>(&*ii);
-              unsigned idx = phiInst->  getBasicBlockIndex (&bb);
-              if (idx < phiInst->getNumIncomingValues()){
-                Value* v = phiInst -> getIncomingValue(idx);
-                if (isa<Instruction>(v) || isa<Argument>(v))
-                {
-                  (*next)[(*index)[v]] = true;
-                }
+        // keep the numbering in step with the changes update() is told of
+        void blockChanged(BasicBlock &bb) { numbering.reindex(&bb); }
+
+        void erasing(Instruction &I) {
+          numbering.erase(&I);
+          recheck.erase(&I);
+          // its operands lose a use, maybe their last one outside their block
+          for (User::op_iterator op = I.op_begin(), oe = I.op_end(); op != oe; ++op)
+            recheck.insert(*op);
+        }
+
+        void replacing(Value *from, Value *to) {
+          recheck.insert(from);
+          recheck.insert(to);
+        }
+
+        /* values the reported changes may have made start or stop crossing
+         * blocks, looked at again by update() */
+        SmallPtrSet<Value*, 16> recheck;
+
+        /* Under -liveness-prune only values used outside their own block have
+         * bits below numCrossing, the width of in and out. A change that
+         * moves a value across that line leaves no room for it (or keeps a
+         * bit for it in every boundary set), so instead of solving the
+         * changed blocks again the whole function is analyzed afresh. */
+        void update() {
+          if (LivenessPrune && !Base::changed.empty()) {
+            // operands of the changed blocks may now be used outside their own
+            for (unsigned i = 0; i < Base::changed.size(); i++) {
+              BasicBlock *bb = Base::order[Base::changed[i]];
+              for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+                for (User::op_iterator op = ii->op_begin(), oe = ii->op_end(); op != oe; ++op)
+                  recheck.insert(*op);
               }
             }
+            bool moved = false;
+            for (SmallPtrSet<Value*, 16>::iterator vi = recheck.begin(), ve = recheck.end(); vi != ve && !moved; ++vi)
+              moved = crossingChanged(*vi);
+            recheck.clear();
+            if (moved) {
+              Base::changed.clear();
+              Base::edgesChanged = false;
+              analyze(*Base::order[0]->getParent());
+              return;
+            }
           }
+          recheck.clear();
+          Base::update();
+        }
 
-          // go through instructions in reverse
-          BasicBlock::iterator ii = --(bb.end()), ib = bb.begin();
-          while (true) {
-            
-            // inherit data from next instruction
-            inst = &*ii;
-            instVec = (*instIn)[inst];            
-            *instVec = *next;
-            
-            // if this instruction is a new definition, remove it
-            if (isDefinition(inst))
-              (*instVec)[(*index)[inst]] = false;
-                            
-            // add the arguments, unless it is a phi node
-            if (!isa<PHINode>(*ii)) {
-            User::op_iterator OI, OE;
-            for (OI = inst->op_begin(), OE=inst->op_end(); OI != OE; ++OI) {
-              if (isa<Instruction>(*OI) || isa<Argument>(*OI)) {
-                (*instVec)[(*index)[*OI]] = true;
+        // true if v is a definition on the wrong side of numCrossing now
+        bool crossingChanged(Value *v) {
+          // arguments always have a boundary bit
+          Instruction *I = dyn_cast<Instruction>(v);
+          if (!I) return false;
+          unsigned bit = numbering.lookup(I);
+          if (bit == ValueNumbering::NONE) return false;
+          return (bit < (unsigned)numCrossing) != usedOutside(I, I->getParent());
+        }
+
+        bool hasBlockSummaries() { return !LivenessSSA; }
+
+        // walks over a block go by position
+        const ValueNumbering *instructionNumbering() { return &numbering; }
+
+        // with -liveness-ssa, every value that can cross a block boundary is traced from its uses
+        bool solveDirectly(Function &F) {
+          if (!LivenessSSA) return false;
+          ssa.runOnFunction(F);
+          std::vector<unsigned> liveIn, liveOut;
+          for (int i = 0; i < numCrossing; i++) {
+            liveIn.clear();
+            liveOut.clear();
+            ssa.liveBlocks(numbering.value(i), liveIn, liveOut);
+            for (unsigned k = 0; k < liveIn.size(); k++)
+              (*in)[ssa.block(liveIn[k])].set(i);
+            for (unsigned k = 0; k < liveOut.size(); k++)
+              (*out)[ssa.block(liveOut[k])].set(i);
+          }
+          return true;
+        }
+
+        // in[b] = gen | (out[b] - kill), composed from the instructions in reverse
+        void getBlockSummary(BasicBlock& bb, Set gen, Set kill) {
+          // phi-captured nodes from this same block are live at the bottom
+          for (BasicBlock::iterator ii = bb.begin(), ib = bb.end(); ii != ib; ++ii) {
+            if (PHINode* phiInst = dyn_cast<PHINode>(&*ii)) {
+              unsigned idx = phiInst->getBasicBlockIndex(&bb);
+              if (idx < phiInst->getNumIncomingValues()) {
+                unsigned v = numbering.lookup(phiInst->getIncomingValue(idx));
+                if (v != ValueNumbering::NONE)
+                  gen.set(v);
               }
             }
+          }
+
+          // bottom to top by position; ids past numCrossing include NONE
+          std::pair<unsigned, unsigned> range = numbering.block(&bb);
+          for (unsigned p = range.second; p-- > range.first; ) {
+            // a definition kills itself, and is no longer generated above this point
+            unsigned def = numbering.instIds[p];
+            if (def < (unsigned)numCrossing) {
+              gen.reset(def);
+              kill.set(def);
             }
-            next = instVec;
 
-            if (ii == ib) break;
-            --ii;
+            // uses are generated, unless it is a phi node
+            if (!isa<PHINode>(numbering.insts[p])) {
+              for (const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p); op != oe; ++op) {
+                if (*op < (unsigned)numCrossing)
+                  gen.set(*op);
+              }
+            }
           }
-          
-          // remove the phi nodes from in 
-          instVec = new BitVector(*instVec);
+        }
+
+        void enterBlock(BasicBlock& bb, Set next) {
+          // add local phi-captured nodes to out          
           for (BasicBlock::iterator ii = bb.begin(), ib = bb.end(); ii != ib; ++ii) {
             if (isa<PHINode>(*ii)) {
               PHINode* phiInst = cast<PHINode>(&*ii);
               unsigned idx = phiInst->  getBasicBlockIndex (&bb);
               if (idx < phiInst->getNumIncomingValues()){
-                Value* v = phiInst -> getIncomingValue(idx);
-                if (isa<Instruction>(v) || isa<Argument>(v))
+                unsigned v = numbering.lookup(phiInst->getIncomingValue(idx));
+                if (v != ValueNumbering::NONE)
                 {
-                  (*next)[(*index)[v]] = false;
+                  next.set(v);
                 }
               }
             }
           }
-          return instVec;
+        }
+
+        // turns the set after inst into the set before it
+        void transferInstruction(Instruction& inst, Set instVec) {
+          transferAt(numbering.position(&inst), instVec);
+        }
+
+        // the same for the instruction at position p, without a lookup
+        void transferAt(unsigned p, Set instVec) {
+          // if this instruction is a new definition, remove it
+          if (numbering.instIds[p] != ValueNumbering::NONE)
+            instVec.reset(numbering.instIds[p]);
+                          
+          // add the arguments, unless it is a phi node
+          if (!isa<PHINode>(numbering.insts[p])) {
+            for (const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p); op != oe; ++op) {
+              if (*op != ValueNumbering::NONE) {
+                instVec.set(*op);
+              }
+            }
+          }
         }
         
-        virtual void displayResults(Function &F) {
+        void displayResults(Function &F) {
           // iterate over basic blocks
           Function::iterator bi = F.begin(), be = (F.end());
-          printBV( (*out)[&*bi] ); // entry node
+          printOut(&*bi); // entry node
           for (; bi != be; ) {            
-            errs() << bi->getName() << ":\n"; //Display labels for basic blocks
+            *os << bi->getName() << ":\n"; //Display labels for basic blocks
           
             // iterate over remaining instructions except very first one
             BasicBlock::iterator ii = bi->begin(), ie = (bi->end());
-            errs() << "\t" << *ii << "\n";
+            *os << "\t" << *ii << "\n";
             for (ii++; ii != ie; ii++) {
               if (!isa<PHINode>(*(ii))) {
-                printBV( (*instIn)[&*ii] );
+                printBefore(&*ii);
               }
-              errs() << "\t" << *ii << "\n";
+              *os << "\t" << *ii << "\n";
             }
             
             // display in[bb]
             ++bi;
             
             if (bi != be && !isa<PHINode>(*((bi)->begin())))
-              printBV( (*out)[&*bi] );
+              printOut(&*bi);
+
+            *os << "\n";
+          }
+          printOut(&*(--bi));
+        }
+
+        // the sets displayResults shows, or with -liveness-query whether they hold the one value
+        void printOut(BasicBlock *bb) {
+          if (queryBit == ValueNumbering::NONE) printBV((*out)[bb]);
+          else printQuery(Base::queryOut(bb, queryBit));
+        }
+
+        void printBefore(Instruction *I) {
+          if (queryBit == ValueNumbering::NONE) printBV(setBefore(I));
+          else printQuery(Base::queryBefore(I, queryBit));
+        }
 
-            errs() << "\n";
+        void printQuery(bool live) {
+          *os << "{ ";
+          if (live) {
+            WriteAsOperand(*os, numbering.value(queryBit), false);
+            *os << " ";
           }
-          printBV( (*out)[&*(--bi)] );
+          *os << "}\n";
         }
         
-        virtual void printBV(BitVector *bv) {
-          errs() << "{ ";
-          for (int i=0; i < numTotal; i++) {
-            if ( (*bv)[i] ) {
-              WriteAsOperand(errs(), (*r_index)[i], false);
-              errs() << " ";
+        void printBV(Set bv) {
+          *os << "{ ";
+          for (int k = 0; k < numTotal; k++) {
+            // boundary sets stop at numCrossing
+            int i = displayOrder[k];
+            if ( (unsigned)i < bv.size() && bv[i] ) {
+              WriteAsOperand(*os, numbering.value(i), false);
+              *os << " ";
             }
           }
-          errs() << "}\n";
+          *os << "}\n";
         }
     
     };
 
+    static cl::opt<std::string> LivenessSets("liveness-sets",
+        cl::desc("Set representation for -Liveness: auto, dense or sparse"), cl::init("auto"));
+
+    static cl::opt<std::string> LivenessStats("liveness-stats",
+        cl::desc("Write per-function solver counters of -Liveness to this file: CSV if it ends in .csv, JSON otherwise, - for stderr"));
+
+    static cl::opt<std::string> LivenessTrace("liveness-trace",
+        cl::desc("Write a timeline of -Liveness phases to this file at exit, in trace event JSON"));
+
+    static cl::opt<unsigned> LivenessThreads("liveness-threads",
+        cl::desc("Threads for -LivenessParallel, 0 for one per core"), cl::init(0));
+
+    // one analysis per set representation, and the choice between them
+    struct LivenessRunner
+    {
+        LivenessAnalysis<DenseMatrix> dense;
+        LivenessAnalysis<SparseMatrix> sparse;
+        LivenessAnalysis<FixedMatrix<1> > fixed1;
+        LivenessAnalysis<FixedMatrix<2> > fixed2;
+
+        // counters of the last run
+        SolverStats stats;
+
+        template<class Analysis>
+        bool runWith(Analysis &a, Function &F) {
+          bool modified = a.runOnFunction(F);
+          stats = a.stats;
+          return modified;
+        }
+
+        void releaseMemory() {
+          dense.releaseMemory();
+          sparse.releaseMemory();
+          fixed1.releaseMemory();
+          fixed2.releaseMemory();
+        }
+
+        // analyzes F and prints the results to os
+        bool run(Function &F, raw_ostream &os) {
+          dense.os = sparse.os = fixed1.os = fixed2.os = &os;
+
+          if (LivenessSets == "sparse")
+            return runWith(sparse, F);
+          if (LivenessSets == "dense")
+            return runWith(dense, F);
+
+          /* Only values used outside their own block can be live at a block
+           * boundary, so their share of all tracked values bounds how full
+           * in[b] and out[b] can get. Pruning already drops the others from
+           * those sets; what is left is estimated from the blocks each
+           * crossing value is defined or used in, as a share of all blocks:
+           * the boundaries it is at least live at. */
+          unsigned tracked = 0, crossing = 0;
+          double touched = 0;
+          for (Function::arg_iterator ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++) {
+            tracked++;
+            crossing++;
+            if (LivenessPrune) touched += LivenessAnalysis<DenseMatrix>::blocksTouched(&*ai, &F.getEntryBlock());
+          }
+          for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
+            if (LivenessAnalysis<DenseMatrix>::isDefinition(&*ii)) {
+              tracked++;
+              if (!LivenessAnalysis<DenseMatrix>::usedOutside(&*ii, ii->getParent())) continue;
+              crossing++;
+              if (LivenessPrune) touched += LivenessAnalysis<DenseMatrix>::blocksTouched(&*ii, ii->getParent());
+            }
+          }
+
+          if (LivenessPrune ? useSparseSets(crossing, crossing ? touched / crossing / F.size() : 0)
+                            : useSparseSets(tracked, tracked ? (double)crossing / tracked : 0))
+            return runWith(sparse, F);
+
+          // per-instruction sets hold every tracked value, pruned or not
+          if (tracked <= FIXED1_MAX_BITS)
+            return runWith(fixed1, F);
+          if (tracked <= FIXED2_MAX_BITS)
+            return runWith(fixed2, F);
+          return runWith(dense, F);
+        }
+    };
+
+    static cl::opt<bool> LivenessCheckUpdate("liveness-check-update",
+        cl::desc("Check -Liveness update() against a fresh solve after moving values across blocks"), cl::init(false));
+
+    // the values in s, in bit order
+    template<class Analysis>
+    static std::vector<Value*> liveValues(Analysis &a, typename Analysis::Set s) {
+      std::vector<Value*> values;
+      for (unsigned i = 0; i < s.size(); i++) {
+        if (s[i]) values.push_back(a.numbering.value(i));
+      }
+      std::sort(values.begin(), values.end());
+      return values;
+    }
+
+    /* For -liveness-check-update. In each block, the uses of a value that
+     * crosses blocks are handed to an earlier value of the same type that
+     * doesn't, which then does. The analysis is told, updated, and compared
+     * at every point with one that starts over; then F is put back as it
+     * was. Returns the number of points that differ. */
+    static unsigned checkUpdate(Function &F) {
+      typedef LivenessAnalysis<DenseMatrix> Analysis;
+      Analysis updated, fresh;
+      if (!updated.analyze(F)) return 0;
+
+      std::vector<std::pair<Instruction*, Instruction*> > moves;
+      for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+        std::vector<Instruction*> local;
+        for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+          if (!Analysis::isDefinition(&*ii) || ii->getType()->isVoidTy()) continue;
+          if (!Analysis::usedOutside(&*ii, &*bb)) {
+            local.push_back(&*ii);
+            continue;
+          }
+          unsigned j = 0;
+          while (j < local.size() && local[j]->getType() != ii->getType()) j++;
+          if (j < local.size()) {
+            moves.push_back(std::make_pair(&*ii, local[j]));
+            break;
+          }
+        }
+      }
+
+      // the uses each move took, to give back
+      std::vector<std::vector<Use*> > taken(moves.size());
+      for (unsigned m = 0; m < moves.size(); m++) {
+        Instruction *from = moves[m].first;
+        for (Value::use_iterator UI = from->use_begin(), UE = from->use_end(); UI != UE; ++UI)
+          taken[m].push_back(&UI.getUse());
+        updated.usesReplaced(from, moves[m].second);
+        from->replaceAllUsesWith(moves[m].second);
+      }
+      updated.update();
+      fresh.analyze(F);
+
+      unsigned differ = 0;
+      for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
+        if (liveValues(updated, updated.setBefore(&*ii)) != liveValues(fresh, fresh.setBefore(&*ii)))
+          differ++;
+      }
+
+      for (unsigned m = moves.size(); m-- > 0; ) {
+        for (unsigned u = 0; u < taken[m].size(); u++)
+          taken[m][u]->set(moves[m].first);
+      }
+      errs() << "update check of " << F.getName() << ": " << moves.size() << " values moved, "
+             << differ << " points differ\n";
+      return differ;
+    }
+
+    struct Liveness : public FunctionPass
+    {
+        static char ID;
+
+        Liveness() : FunctionPass(ID) {}
+
+        LivenessRunner runner;
+        std::vector<SolverStats> allStats;
+
+        virtual bool runOnFunction(Function &F) {
+          if (!LivenessTrace.empty()) startTrace(LivenessTrace);
+          bool modified = runner.run(F, errs());
+          if (!LivenessStats.empty()) allStats.push_back(runner.stats);
+          if (LivenessCheckUpdate && LivenessQuery.empty()) checkUpdate(F);
+          return modified;
+        }
+
+        // called once the pass manager is done with F
+        virtual void releaseMemory() { runner.releaseMemory(); }
+
+        virtual bool doFinalization(Module &M) {
+          if (!LivenessStats.empty()) writeStats(LivenessStats, "liveness", allStats);
+          return false;
+        }
+    };
+
+    // the same for a whole module, with the functions spread over threads
+    struct LivenessParallel : public ModulePass
+    {
+        static char ID;
+
+        LivenessParallel() : ModulePass(ID) {}
+
+        virtual bool runOnModule(Module &M) {
+          if (!LivenessTrace.empty()) startTrace(LivenessTrace);
+          std::vector<SolverStats> stats;
+          runParallel<LivenessRunner>(M, LivenessThreads, errs(), stats);
+          if (!LivenessStats.empty()) writeStats(LivenessStats, "liveness", stats);
+          return false;
+        }
+    };
+
     char Liveness::ID = 0;
     static RegisterPass<Liveness> x("Liveness", "Liveness", false, false);
+
+    char LivenessParallel::ID = 0;
+    static RegisterPass<LivenessParallel> y("LivenessParallel", "Liveness on all functions at once", false, false);
 }
 
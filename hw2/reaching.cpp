@@ -12,74 +12,115 @@
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/ADT/BitVector.h"
-#include "llvm/ADT/ValueMap.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/CFG.h"
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Assembly/Writer.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "dataflow.cpp"
+#include "ssareaching.cpp"
 
 #include <ostream>
+#include <string>
 
 using namespace llvm;
 
 namespace
 {
-    struct ReachingDefinitions : public Dataflow<true>, public FunctionPass
+    /* Slower than the iterative solver on every workload measured: a walk
+     * sets its definitions in each block it passes one at a time, where the
+     * solver moves a word of them at once. Kept for comparison. */
+    static cl::opt<bool> ReachingSSA("reaching-ssa", cl::Hidden,
+        cl::desc("Find -ReachingDefinitions by walking forward from each definition instead of iterating"), cl::init(false));
+
+    static cl::opt<std::string> ReachingQuery("reaching-query",
+        cl::desc("Only ask whether this definition (named without the %) reaches each point, on demand instead of solving"));
+
+    static cl::opt<bool> ReachingPrint("reaching-print",
+        cl::desc("Print the reaching definitions at each program point"), cl::init(true));
+
+    static cl::opt<unsigned> ReachingSCC("reaching-scc",
+        cl::desc("Solve -ReachingDefinitions by CFG strongly connected component on this many threads, 0 for one worklist"), cl::init(0));
+
+    // the analysis itself, over any set representation
+    template<class Storage>
+    struct ReachingAnalysis : public DataflowSolver<ReachingAnalysis<Storage>, true, Storage>
     {
-        static char ID;
+        typedef DataflowSolver<ReachingAnalysis<Storage>, true, Storage> Base;
+        typedef typename Base::Set Set;
+        using Base::in;
+        using Base::out;
+        using Base::width;
+        using Base::sccThreads;
+        using Base::stats;
+        using Base::setAfter;
 
-        ReachingDefinitions() : Dataflow<true>(), FunctionPass(ID) {
-          index = new ValueMap<Value*, int>();
-          r_index = new std::vector<Value*>();
-          instOut = new ValueMap<Instruction*, BitVector*>();
+        ReachingAnalysis() : Base() {
+          os = &errs();
         }
 
-        // map from instructions/argument to their index in the bitvector
-        ValueMap<Value*, int> *index;
-        
-        // map from index in bitvector back to instruction/argument
-        std::vector<Value*> *r_index;
+        // bit numbers of the arguments and definitions, and back
+        ValueNumbering numbering;
+
+        // where displayResults prints
+        raw_ostream *os;
+
+        // for -reaching-ssa, with rows for the blocks that make many definitions
+        SSAReaching ssa;
+        Storage masks;
+
+        // bit of the -reaching-query definition, NONE to print whole sets
+        unsigned queryBit;
         
         // convenience
         int numTotal;
         int numArgs;
 
-		    // map from instructions to bitvector corresponding to program point AFTER that instruction
-        ValueMap<Instruction*, BitVector*> *instOut;
-
         
-        virtual void meet(BitVector *op1, const BitVector *op2) {
+        void meet(Set op1, Set op2) {
         	// union
-          *op1 |= *op2;
+          op1 |= op2;
         }
 
-        virtual void getBoundaryCondition(BitVector *entry) {
+        MeetOp meetOp() { return MEET_UNION; }
+
+        void getBoundaryCondition(Set entry) {
         	// in[b] = just the arguments if no predecessors / entry node
-          *entry = BitVector(numTotal, false);
+          entry.reset();
          	for (int i=0; i < numArgs; ++i) {
-         		(*entry)[i] = true;
+         		entry.set(i);
          	} 	
         }
         
-        bool isDefinition(Instruction *ii) {
+        static bool isDefinition(Instruction *ii) {
           // All other types of instructions are definitions
           return (!(isa<TerminatorInst>(ii) || isa<StoreInst>(ii) || (isa<CallInst>(ii) && cast<CallInst>(ii)->getCalledFunction()->getReturnType()->isVoidTy())));
         }
 
-        BitVector* initialInteriorPoint(BasicBlock& bb) {
+        void initialInteriorPoint(BasicBlock& bb, Set init) {
         	// out[b] = empty set initially
-          return new BitVector(numTotal, false);
+          init.reset();
         }
 
-        virtual bool runOnFunction(Function &F) {
+        // everything kept for the last function, after the solver's own
+        void releaseMemory() {
+          Base::releaseMemory();
+          numbering.clear();
+          ssa.releaseMemory();
+          masks.clear();
+        }
+
+        bool runOnFunction(Function &F) {
+        	double start = wallTime();
+        	traceBegin("index", F);
         	numTotal = 0;
         	numArgs = 0;
+        	numbering.clear();
         	
         	// add function arguments to maps
         	for (Function::arg_iterator ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++) {
-        		(*index)[&*ai] = numArgs;
-        		r_index->push_back(&*ai);
+        		numbering.add(&*ai);
         		numArgs++;
         	}
           numTotal = numArgs; 
@@ -87,107 +128,338 @@ namespace
         	// add definitions to maps
         	for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
         		if (isDefinition(&*ii)) {
-        			(*index)[&*ii] = numTotal;
-        			r_index->push_back(&*ii);
+        			numbering.add(&*ii);
         			numTotal++;
         		}
         	}
+        	numbering.index(F);
          
-          // initialize instOut
-          for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
-            (*instOut)[&*ii] = new BitVector(numTotal, false);
-          }
-        	top = new BitVector(numTotal, false);
+        	width = numTotal;
+        	sccThreads = ReachingSCC;
+
+        	queryBit = ValueNumbering::NONE;
+        	if (!ReachingQuery.empty()) {
+        	  for (int i = 0; i < numTotal; i++) {
+        	    if (numbering.value(i)->getName() == ReachingQuery) queryBit = i;
+        	  }
+        	  // nothing to ask in a function without it, nor to count
+        	  if (queryBit == ValueNumbering::NONE) {
+        	    stats.clear();
+        	    stats.function = F.getName().str();
+        	    stats.storage = Storage::name();
+        	    return false;
+        	  }
+        	}
         	
-          // run data flow 
-        	Dataflow<true>::runOnFunction(F);
+          // run data flow, or get ready to answer queries
+        	double indexTime = wallTime() - start;
+        	traceEnd("index", F);
+        	if (queryBit != ValueNumbering::NONE) {
+        	  Base::prepareQueries(F);
+        	} else {
+        	  Base::runOnFunction(F);
+        	}
+        	stats.time[PHASE_INDEX] = indexTime;
          
           // print out instructions with reaching variables between each instruction 
-        	displayResults(F);
+        	start = wallTime();
+        	traceBegin("output", F);
+        	if (ReachingPrint) displayResults(F);
+        	stats.time[PHASE_OUTPUT] = wallTime() - start;
+        	traceEnd("output", F);
         	
           // didn't modify nothing 
         	return false;
         }
         
-        virtual BitVector* transfer(BasicBlock& bb) {
-          // we iterate over instructions beginning with in[bb]
-          BitVector* prev = (*in)[&bb];
-          
-          // temporary variables for convenience
-          BitVector* instVec = prev; // for empty blocks
-          Instruction* inst;
-
-          for (BasicBlock::iterator ii = bb.begin(), ie = bb.end(); ii != ie; ii++) {
-            // begin with previous reaching definitions
-            inst = &*ii;
-            instVec = (*instOut)[inst];            
-            *instVec = *prev;
-            
-            // if this instruction is a new definition, add it
-            if (isDefinition(inst))
-              (*instVec)[(*index)[inst]] = true;
-            
-            // if it is a phi node, kill the stuff
-            if (isa<PHINode>(inst)) {
-              PHINode* p = cast<PHINode>(inst);
-              unsigned num = p->getNumIncomingValues();
-              for (int i=0; i < num; ++i) {
-                Value* v = p->getIncomingValue(i);
-                if (isa<Instruction>(v) || isa<Argument>(v)) {
-                  (*instVec)[(*index)[v]] = false;
+        // keeps the numbering in step with the changes update() is told of
+        void blockChanged(BasicBlock &bb) { numbering.reindex(&bb); }
+        void erasing(Instruction &I) { numbering.erase(&I); }
+
+        bool hasBlockSummaries() { return !ReachingSSA; }
+
+        // walks over a block go by position
+        const ValueNumbering *instructionNumbering() { return &numbering; }
+
+        /* with -reaching-ssa, every definition is followed forward from where
+         * it is made. Those with no phi users all get as far as the others
+         * from the same block, so they share one walk; a block that makes
+         * enough of them for it to pay has them ORed in as one row. */
+        bool solveDirectly(Function &F) {
+          if (!ReachingSSA) return false;
+          ssa.runOnFunction(F);
+
+          // definitions without phi users by the block they are made in, null for the arguments
+          DenseMap<BasicBlock*, unsigned> group;
+          std::vector<std::vector<unsigned> > shared;
+          std::vector<unsigned> reachIn, reachOut;
+          for (int i = 0; i < numTotal; i++) {
+            Value *v = numbering.value(i);
+            if (!SSAReaching::hasPhiUsers(v)) {
+              Instruction *I = dyn_cast<Instruction>(v);
+              std::pair<DenseMap<BasicBlock*, unsigned>::iterator, bool> g =
+                group.insert(std::make_pair(I ? I->getParent() : 0, (unsigned)shared.size()));
+              if (g.second) shared.push_back(std::vector<unsigned>());
+              shared[g.first->second].push_back(i);
+              continue;
+            }
+            reachIn.clear();
+            reachOut.clear();
+            ssa.reachBlocks(v, reachIn, reachOut);
+            for (unsigned k = 0; k < reachIn.size(); k++)
+              (*in)[ssa.block(reachIn[k])].set(i);
+            for (unsigned k = 0; k < reachOut.size(); k++)
+              (*out)[ssa.block(reachOut[k])].set(i);
+          }
+
+          // a row costs a word per BITWORD_SIZE bits of width, setting the bits one each
+          unsigned rows = 0;
+          for (unsigned g = 0; g < shared.size(); g++) {
+            if (shared[g].size() * BITWORD_SIZE > width) rows++;
+          }
+          masks.resize(rows, width, Base::arena);
+
+          rows = 0;
+          for (unsigned g = 0; g < shared.size(); g++) {
+            const std::vector<unsigned> &bits = shared[g];
+            reachIn.clear();
+            reachOut.clear();
+            ssa.reachBlocks(numbering.value(bits[0]), reachIn, reachOut);
+            if (bits.size() * BITWORD_SIZE > width) {
+              Set mask = masks.row(rows++);
+              for (unsigned j = 0; j < bits.size(); j++) mask.set(bits[j]);
+              for (unsigned k = 0; k < reachIn.size(); k++)
+                (*in)[ssa.block(reachIn[k])] |= mask;
+              for (unsigned k = 0; k < reachOut.size(); k++)
+                (*out)[ssa.block(reachOut[k])] |= mask;
+              continue;
+            }
+            for (unsigned k = 0; k < reachIn.size(); k++) {
+              Set s = (*in)[ssa.block(reachIn[k])];
+              for (unsigned j = 0; j < bits.size(); j++) s.set(bits[j]);
+            }
+            for (unsigned k = 0; k < reachOut.size(); k++) {
+              Set s = (*out)[ssa.block(reachOut[k])];
+              for (unsigned j = 0; j < bits.size(); j++) s.set(bits[j]);
+            }
+          }
+          return true;
+        }
+
+        // out[b] = gen | (in[b] - kill), composed from the instructions in order
+        void getBlockSummary(BasicBlock& bb, Set gen, Set kill) {
+          std::pair<unsigned, unsigned> range = numbering.block(&bb);
+          for (unsigned p = range.first; p < range.second; p++) {
+            // a new definition is generated
+            unsigned def = numbering.instIds[p];
+            if (def != ValueNumbering::NONE)
+              gen.set(def);
+
+            // a phi node kills its incoming definitions
+            if (isa<PHINode>(numbering.insts[p])) {
+              for (const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p); op != oe; ++op) {
+                if (*op != ValueNumbering::NONE) {
+                  gen.reset(*op);
+                  kill.set(*op);
                 }
               }
             }
-            
-            prev = instVec;
           }
+        }
+
+        // turns the set before inst into the set after it
+        void transferInstruction(Instruction& inst, Set instVec) {
+          transferAt(numbering.position(&inst), instVec);
+        }
+
+        // the same for the instruction at position p, without a lookup
+        void transferAt(unsigned p, Set instVec) {
+          // if this instruction is a new definition, add it
+          if (numbering.instIds[p] != ValueNumbering::NONE)
+            instVec.set(numbering.instIds[p]);
           
-          // return a copy of the final instruction's post-condition to put in out[bb]
-          return new BitVector(*instVec);
+          // if it is a phi node, kill the stuff
+          if (isa<PHINode>(numbering.insts[p])) {
+            for (const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p); op != oe; ++op) {
+              if (*op != ValueNumbering::NONE) {
+                instVec.reset(*op);
+              }
+            }
+          }
         }
         
-        virtual void displayResults(Function &F) {
+        void displayResults(Function &F) {
           // iterate over basic blocks
           Function::iterator bi = F.begin(), be = (F.end());
           for (; bi != be; bi++) {
-            errs() << bi->getName() << ":\n"; //Display labels for basic blocks
+            *os << bi->getName() << ":\n"; //Display labels for basic blocks
             // display in[bb]
             if (!isa<PHINode>(*(bi->begin())))
-              printBV( (*in)[&*bi] );
+              printIn(&*bi);
             
             // iterate over remaining instructions except very last one
             // we don't print out[i] for the last one because we should actually print out the
             // result of the meet operator at those points, i.e. in[next block]...              
             BasicBlock::iterator ii = bi->begin(), ie = --(bi->end());
             for (; ii != ie; ii++) {
-              errs() << "\t" << *ii << "\n";
+              *os << "\t" << *ii << "\n";
               if (!isa<PHINode>(*(++ii))) {
                 --ii;
-                printBV( (*instOut)[&*ii] );
+                printAfter(&*ii);
               } else --ii;
               
             }
-            errs() << "\t" << *(ii) << "\n";
-            errs() << "\n";
+            *os << "\t" << *(ii) << "\n";
+            *os << "\n";
           }
           // ...unless there are no more blocks
-          printBV( (*out)[&*(--be)] );
+          printOut(&*(--be));
+        }
+
+        // the sets displayResults shows, or with -reaching-query whether they hold the one definition
+        void printIn(BasicBlock *bb) {
+          if (queryBit == ValueNumbering::NONE) printBV((*in)[bb]);
+          else printQuery(Base::queryIn(bb, queryBit));
+        }
+
+        void printOut(BasicBlock *bb) {
+          if (queryBit == ValueNumbering::NONE) printBV((*out)[bb]);
+          else printQuery(Base::queryOut(bb, queryBit));
+        }
+
+        void printAfter(Instruction *I) {
+          if (queryBit == ValueNumbering::NONE) printBV(setAfter(I));
+          else printQuery(Base::queryAfter(I, queryBit));
+        }
+
+        void printQuery(bool reaches) {
+          *os << "{ ";
+          if (reaches) {
+            WriteAsOperand(*os, numbering.value(queryBit), false);
+            *os << " ";
+          }
+          *os << "}\n";
         }
         
-        virtual void printBV(BitVector *bv) {
-          errs() << "{ ";
+        void printBV(Set bv) {
+          *os << "{ ";
           for (int i=0; i < numTotal; i++) {
-            if ( (*bv)[i] ) {
-              WriteAsOperand(errs(), (*r_index)[i], false);
-              errs() << " ";
+            if ( bv[i] ) {
+              WriteAsOperand(*os, numbering.value(i), false);
+              *os << " ";
             }
           }
-          errs() << "}\n";
+          *os << "}\n";
         }
     
     };
 
+    static cl::opt<std::string> ReachingSets("reaching-sets",
+        cl::desc("Set representation for -ReachingDefinitions: auto, dense or sparse"), cl::init("auto"));
+
+    static cl::opt<std::string> ReachingStats("reaching-stats",
+        cl::desc("Write per-function solver counters of -ReachingDefinitions to this file: CSV if it ends in .csv, JSON otherwise, - for stderr"));
+
+    static cl::opt<std::string> ReachingTrace("reaching-trace",
+        cl::desc("Write a timeline of -ReachingDefinitions phases to this file at exit, in trace event JSON"));
+
+    static cl::opt<unsigned> ReachingThreads("reaching-threads",
+        cl::desc("Threads for -ReachingDefinitionsParallel, 0 for one per core"), cl::init(0));
+
+    // one analysis per set representation, and the choice between them
+    struct ReachingRunner
+    {
+        ReachingAnalysis<DenseMatrix> dense;
+        ReachingAnalysis<SparseMatrix> sparse;
+        ReachingAnalysis<FixedMatrix<1> > fixed1;
+        ReachingAnalysis<FixedMatrix<2> > fixed2;
+
+        // counters of the last run
+        SolverStats stats;
+
+        template<class Analysis>
+        bool runWith(Analysis &a, Function &F) {
+          bool modified = a.runOnFunction(F);
+          stats = a.stats;
+          return modified;
+        }
+
+        void releaseMemory() {
+          dense.releaseMemory();
+          sparse.releaseMemory();
+          fixed1.releaseMemory();
+          fixed2.releaseMemory();
+        }
+
+        // analyzes F and prints the results to os
+        bool run(Function &F, raw_ostream &os) {
+          dense.os = sparse.os = fixed1.os = fixed2.os = &os;
+
+          /* Nothing but phis kills a definition, so every definition reaches
+           * every point it dominates and in[b] holds a good share of all
+           * values. auto therefore stays dense, in registers if the function
+           * is small enough; sparse has to be asked for. */
+          if (ReachingSets == "sparse")
+            return runWith(sparse, F);
+          if (ReachingSets == "dense")
+            return runWith(dense, F);
+
+          unsigned tracked = F.arg_size();
+          for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
+            if (ReachingAnalysis<DenseMatrix>::isDefinition(&*ii)) tracked++;
+          }
+          if (tracked <= FIXED1_MAX_BITS)
+            return runWith(fixed1, F);
+          if (tracked <= FIXED2_MAX_BITS)
+            return runWith(fixed2, F);
+          return runWith(dense, F);
+        }
+    };
+
+    struct ReachingDefinitions : public FunctionPass
+    {
+        static char ID;
+
+        ReachingDefinitions() : FunctionPass(ID) {}
+
+        ReachingRunner runner;
+        std::vector<SolverStats> allStats;
+
+        virtual bool runOnFunction(Function &F) {
+          if (!ReachingTrace.empty()) startTrace(ReachingTrace);
+          bool modified = runner.run(F, errs());
+          if (!ReachingStats.empty()) allStats.push_back(runner.stats);
+          return modified;
+        }
+
+        // called once the pass manager is done with F
+        virtual void releaseMemory() { runner.releaseMemory(); }
+
+        virtual bool doFinalization(Module &M) {
+          if (!ReachingStats.empty()) writeStats(ReachingStats, "reaching", allStats);
+          return false;
+        }
+    };
+
+    // the same for a whole module, with the functions spread over threads
+    struct ReachingDefinitionsParallel : public ModulePass
+    {
+        static char ID;
+
+        ReachingDefinitionsParallel() : ModulePass(ID) {}
+
+        virtual bool runOnModule(Module &M) {
+          if (!ReachingTrace.empty()) startTrace(ReachingTrace);
+          std::vector<SolverStats> stats;
+          runParallel<ReachingRunner>(M, ReachingThreads, errs(), stats);
+          if (!ReachingStats.empty()) writeStats(ReachingStats, "reaching", stats);
+          return false;
+        }
+    };
+
     char ReachingDefinitions::ID = 0;
     static RegisterPass<ReachingDefinitions> x("ReachingDefinitions", "ReachingDefinitions", false, false);
-}
 
+    char ReachingDefinitionsParallel::ID = 0;
+    static RegisterPass<ReachingDefinitionsParallel> y("ReachingDefinitionsParallel", "ReachingDefinitions on all functions at once", false, false);
+}
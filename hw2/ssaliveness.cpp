@@ -0,0 +1,224 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+
+#include "llvm/Function.h"
+#include "llvm/BasicBlock.h"
+#include "llvm/Instructions.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CFG.h"
+
+#include <vector>
+#include <algorithm>
+
+using namespace llvm;
+
+namespace
+{
+    /* Liveness of SSA values without a fixed point. A value is live exactly
+     * on the paths that lead from its uses back up to its definition, so
+     * walking the CFG backwards from each use, and stopping at the defining
+     * block, finds every block it is live into or out of. Each value costs
+     * the blocks it is live in, and only the values asked about are walked:
+     * a client with a few queries pays for those. The Liveness pass can
+     * fill in[b]/out[b] with one walk per value (-liveness-ssa), but that
+     * is slower than iterating when many values are live everywhere.
+     *
+     * The answers are the Liveness pass' own. In particular an incoming
+     * value of a phi counts as used at the bottom of the phi's block when
+     * the phi takes it from that same block (a self loop), and not on other
+     * incoming edges. */
+    struct SSALiveness {
+      SSALiveness() : stamp(0) {}
+
+      enum { NONE = ~0u };
+
+      // blocks by number, and back
+      std::vector<BasicBlock*> blocks;
+      DenseMap<BasicBlock*, unsigned> number;
+
+      // predecessors of block b: preds[predStart[b]] .. preds[predStart[b+1]-1]
+      std::vector<unsigned> preds, predStart;
+
+      // blocks reachable from the entry, where every use is dominated by its definition
+      std::vector<bool> reachable;
+
+      // blocks a value is live into and out of, sorted by number
+      struct LiveBlocks {
+        std::vector<unsigned> in, out;
+      };
+
+      // what each value asked about came to
+      std::vector<LiveBlocks> cache;
+      DenseMap<Value*, unsigned> cached;
+
+      // marks for the walk of one value: block b is done if inMark[b] == stamp
+      std::vector<unsigned> inMark, outMark;
+      unsigned stamp;
+      std::vector<unsigned> stack;
+
+      /* Numbers the blocks of F and records its predecessors. Nothing is
+       * computed for any value until it is asked about. */
+      void runOnFunction(Function &F) {
+        releaseMemory();
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          number[&*bb] = blocks.size();
+          blocks.push_back(&*bb);
+        }
+        unsigned n = blocks.size();
+        for (unsigned b = 0; b < n; b++) {
+          predStart.push_back(preds.size());
+          for (pred_iterator PI = pred_begin(blocks[b]), PE = pred_end(blocks[b]); PI != PE; ++PI) {
+            preds.push_back(number[*PI]);
+          }
+        }
+        predStart.push_back(preds.size());
+
+        reachable.assign(n, false);
+        if (n) {
+          stack.push_back(0);
+          reachable[0] = true;
+        }
+        while (!stack.empty()) {
+          BasicBlock *bb = blocks[stack.back()];
+          stack.pop_back();
+          for (succ_iterator SI = succ_begin(bb), SE = succ_end(bb); SI != SE; ++SI) {
+            unsigned s = number[*SI];
+            if (!reachable[s]) {
+              reachable[s] = true;
+              stack.push_back(s);
+            }
+          }
+        }
+
+        inMark.assign(n, 0);
+        outMark.assign(n, 0);
+        stamp = 0;
+      }
+
+      void releaseMemory() {
+        blocks.clear();
+        number.clear();
+        preds.clear();
+        predStart.clear();
+        reachable.clear();
+        cache.clear();
+        cached.clear();
+      }
+
+      /* Appends the blocks v is live into and out of, unsorted. v is an
+       * argument or an instruction of the function. */
+      void liveBlocks(Value *v, std::vector<unsigned> &in, std::vector<unsigned> &out) {
+        unsigned def = NONE;
+        if (Instruction *I = dyn_cast<Instruction>(v)) def = number[I->getParent()];
+        if (++stamp == 0) {
+          // wrapped around, so old marks could look current
+          std::fill(inMark.begin(), inMark.end(), 0);
+          std::fill(outMark.begin(), outMark.end(), 0);
+          stamp = 1;
+        }
+
+        for (Value::use_iterator UI = v->use_begin(), UE = v->use_end(); UI != UE; ++UI) {
+          Instruction *user = dyn_cast<Instruction>(*UI);
+          if (!user) continue;
+          unsigned b = number[user->getParent()];
+          if (PHINode *phi = dyn_cast<PHINode>(user)) {
+            // live at the bottom of the phi's block, if it loops back to itself
+            if (b != def && usedByOwnPhi(v, phi)) liveIn(b, in);
+          } else if (b != def || usedBeforeDef(user, cast<Instruction>(v))) {
+            liveIn(b, in);
+          }
+        }
+
+        // live into b means live out of its predecessors, and into them unless they define v
+        while (!stack.empty()) {
+          unsigned b = stack.back();
+          stack.pop_back();
+          for (unsigned e = predStart[b]; e < predStart[b + 1]; e++) {
+            unsigned p = preds[e];
+            if (outMark[p] != stamp) {
+              outMark[p] = stamp;
+              out.push_back(p);
+            }
+            if (p != def) liveIn(p, in);
+          }
+        }
+      }
+
+      bool isLiveIn(Value *v, BasicBlock *bb) {
+        const LiveBlocks &l = lookup(v);
+        return std::binary_search(l.in.begin(), l.in.end(), number[bb]);
+      }
+
+      bool isLiveOut(Value *v, BasicBlock *bb) {
+        const LiveBlocks &l = lookup(v);
+        return std::binary_search(l.out.begin(), l.out.end(), number[bb]);
+      }
+
+      /* true if v is live just before I (just after, if !before): as in the
+       * Liveness pass' setBefore and setAfter. Walks the rest of I's block. */
+      bool isLiveAt(Value *v, Instruction *I, bool before) {
+        BasicBlock *bb = I->getParent();
+        BasicBlock::iterator ii(I);
+        if (!before) ++ii;
+        for (BasicBlock::iterator ie = bb->end(); ii != ie; ++ii) {
+          // an instruction's operands are live before it even if it defines v
+          if (!isa<PHINode>(*ii) && uses(&*ii, v)) return true;
+          if (&*ii == v) return false;
+        }
+        if (isLiveOut(v, bb)) return true;
+        for (BasicBlock::iterator ii = bb->begin(); PHINode *phi = dyn_cast<PHINode>(&*ii); ++ii) {
+          if (usedByOwnPhi(v, phi)) return true;
+        }
+        return false;
+      }
+
+      const LiveBlocks &lookup(Value *v) {
+        DenseMap<Value*, unsigned>::iterator it = cached.find(v);
+        if (it != cached.end()) return cache[it->second];
+        cached[v] = cache.size();
+        cache.push_back(LiveBlocks());
+        LiveBlocks &l = cache.back();
+        liveBlocks(v, l.in, l.out);
+        std::sort(l.in.begin(), l.in.end());
+        std::sort(l.out.begin(), l.out.end());
+        return l;
+      }
+
+      BasicBlock *block(unsigned b) const { return blocks[b]; }
+
+      void liveIn(unsigned b, std::vector<unsigned> &in) {
+        if (inMark[b] == stamp) return;
+        inMark[b] = stamp;
+        in.push_back(b);
+        stack.push_back(b);
+      }
+
+      static bool uses(Instruction *I, Value *v) {
+        for (User::op_iterator OI = I->op_begin(), OE = I->op_end(); OI != OE; ++OI) {
+          if (*OI == v) return true;
+        }
+        return false;
+      }
+
+      // true if phi takes v from its own block
+      static bool usedByOwnPhi(Value *v, PHINode *phi) {
+        for (unsigned i = 0, n = phi->getNumIncomingValues(); i < n; i++) {
+          if (phi->getIncomingValue(i) == v && phi->getIncomingBlock(i) == phi->getParent()) return true;
+        }
+        return false;
+      }
+
+      /* true if user, in def's block, reads def before def is computed. That
+       * takes a loop, which dominance rules out except in unreachable code. */
+      bool usedBeforeDef(Instruction *user, Instruction *def) {
+        if (user == def) return true;
+        if (reachable[number[def->getParent()]]) return false;
+        for (BasicBlock::iterator ii = def->getParent()->begin(); ; ++ii) {
+          if (&*ii == user) return true;
+          if (&*ii == def) return false;
+        }
+      }
+    };
+}
@@ -0,0 +1,180 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+
+#include "llvm/Function.h"
+#include "llvm/BasicBlock.h"
+#include "llvm/Instructions.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CFG.h"
+
+#include <vector>
+#include <algorithm>
+
+using namespace llvm;
+
+namespace
+{
+    /* Reaching definitions of SSA values without a fixed point. Nothing
+     * redefines an SSA value, so the only thing that stops one from
+     * reaching further is a phi that takes it as an operand (the
+     * ReachingDefinitions pass kills a phi's operands). Those phis are
+     * among the value's users, so one forward walk from the definition,
+     * which does not go past the blocks of its phi users, finds every block
+     * it reaches the top or bottom of.
+     *
+     * This is a path walk rather than dominance: a definition in one arm of
+     * a branch still reaches the join, as it does in the iterative solver,
+     * so the answers are the same. Values with no phi users only depend on
+     * where they are defined, so -reaching-ssa walks once per block for
+     * those. */
+    struct SSAReaching {
+      SSAReaching() : stamp(0) {}
+
+      enum { NONE = ~0u };
+
+      // blocks by number, and back
+      std::vector<BasicBlock*> blocks;
+      DenseMap<BasicBlock*, unsigned> number;
+
+      // successors of block b: succs[succStart[b]] .. succs[succStart[b+1]-1]
+      std::vector<unsigned> succs, succStart;
+
+      // blocks a definition reaches the top and bottom of, sorted by number
+      struct ReachBlocks {
+        std::vector<unsigned> in, out;
+      };
+
+      // what each value asked about came to
+      std::vector<ReachBlocks> cache;
+      DenseMap<Value*, unsigned> cached;
+
+      // marks for the walk of one value: block b is reached if inMark[b] == stamp
+      std::vector<unsigned> inMark, killMark;
+      unsigned stamp;
+      std::vector<unsigned> stack;
+
+      /* Numbers the blocks of F and records its successors. Nothing is
+       * computed for any value until it is asked about. */
+      void runOnFunction(Function &F) {
+        releaseMemory();
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          number[&*bb] = blocks.size();
+          blocks.push_back(&*bb);
+        }
+        unsigned n = blocks.size();
+        for (unsigned b = 0; b < n; b++) {
+          succStart.push_back(succs.size());
+          for (succ_iterator SI = succ_begin(blocks[b]), SE = succ_end(blocks[b]); SI != SE; ++SI) {
+            succs.push_back(number[*SI]);
+          }
+        }
+        succStart.push_back(succs.size());
+
+        inMark.assign(n, 0);
+        killMark.assign(n, 0);
+        stamp = 0;
+      }
+
+      void releaseMemory() {
+        blocks.clear();
+        number.clear();
+        succs.clear();
+        succStart.clear();
+        cache.clear();
+        cached.clear();
+      }
+
+      /* Appends the blocks the definition of v reaches the top and bottom
+       * of, unsorted. v is an argument or an instruction of the function. */
+      void reachBlocks(Value *v, std::vector<unsigned> &in, std::vector<unsigned> &out) {
+        if (++stamp == 0) {
+          // wrapped around, so old marks could look current
+          std::fill(inMark.begin(), inMark.end(), 0);
+          std::fill(killMark.begin(), killMark.end(), 0);
+          stamp = 1;
+        }
+
+        // the blocks past which v does not get
+        for (Value::use_iterator UI = v->use_begin(), UE = v->use_end(); UI != UE; ++UI) {
+          if (PHINode *phi = dyn_cast<PHINode>(*UI)) killMark[number[phi->getParent()]] = stamp;
+        }
+
+        unsigned def = NONE;
+        if (Instruction *I = dyn_cast<Instruction>(v)) {
+          def = number[I->getParent()];
+          if (!killedAfter(I)) {
+            out.push_back(def);
+            stack.push_back(def);
+          }
+        } else if (!blocks.empty()) {
+          // arguments are there on entry, and no phi can kill them in it
+          inMark[0] = stamp;
+          in.push_back(0);
+          out.push_back(0);
+          stack.push_back(0);
+        }
+
+        // reaching the bottom of b means reaching the top of its successors, and their bottom unless they kill v
+        while (!stack.empty()) {
+          unsigned b = stack.back();
+          stack.pop_back();
+          for (unsigned e = succStart[b]; e < succStart[b + 1]; e++) {
+            unsigned s = succs[e];
+            if (inMark[s] == stamp) continue;
+            inMark[s] = stamp;
+            in.push_back(s);
+            // the bottom of the defining block only depends on what follows the definition
+            if (s != def && killMark[s] != stamp) {
+              out.push_back(s);
+              stack.push_back(s);
+            }
+          }
+        }
+      }
+
+      bool reachesIn(Value *v, BasicBlock *bb) {
+        const ReachBlocks &r = lookup(v);
+        return std::binary_search(r.in.begin(), r.in.end(), number[bb]);
+      }
+
+      bool reachesOut(Value *v, BasicBlock *bb) {
+        const ReachBlocks &r = lookup(v);
+        return std::binary_search(r.out.begin(), r.out.end(), number[bb]);
+      }
+
+      const ReachBlocks &lookup(Value *v) {
+        DenseMap<Value*, unsigned>::iterator it = cached.find(v);
+        if (it != cached.end()) return cache[it->second];
+        cached[v] = cache.size();
+        cache.push_back(ReachBlocks());
+        ReachBlocks &r = cache.back();
+        reachBlocks(v, r.in, r.out);
+        std::sort(r.in.begin(), r.in.end());
+        std::sort(r.out.begin(), r.out.end());
+        return r;
+      }
+
+      BasicBlock *block(unsigned b) const { return blocks[b]; }
+
+      static bool hasPhiUsers(Value *v) {
+        for (Value::use_iterator UI = v->use_begin(), UE = v->use_end(); UI != UE; ++UI) {
+          if (isa<PHINode>(*UI)) return true;
+        }
+        return false;
+      }
+
+      /* true if a phi from I on (I included, as a phi kills its operands
+       * after defining itself) takes I as an operand. Only phis come before
+       * other instructions, so that is all there is to check. */
+      static bool killedAfter(Instruction *I) {
+        for (BasicBlock::iterator ii(I); PHINode *phi = dyn_cast<PHINode>(&*ii); ++ii) {
+          for (unsigned i = 0, n = phi->getNumIncomingValues(); i < n; i++) {
+            if (phi->getIncomingValue(i) == I) return true;
+          }
+        }
+        return false;
+      }
+    };
+}
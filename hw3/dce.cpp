@@ -10,13 +10,17 @@
 #include "llvm/Constants.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/ValueMap.h"
 #include "llvm/Support/CFG.h"
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Assembly/Writer.h"
+#include "llvm/Support/CommandLine.h"
 
-#include "dataflow.cpp"
+// the framework and SideEffects come with it
+#include "marksweep.cpp"
 
 #include <ostream>
 
@@ -24,37 +28,40 @@ using namespace llvm;
 
 namespace
 {
-    struct DCE : public Dataflow<false>, public FunctionPass
+    static cl::opt<bool> DCEAggressive("dce-aggressive",
+        cl::desc("Also remove branches nothing needs, with the loops and ifs they make (not with -dce-faint)"));
+
+    static cl::opt<unsigned> DCESCC("dce-scc",
+        cl::desc("Solve -DCE by CFG strongly connected component on this many threads, 0 for one worklist"), cl::init(0));
+
+    // faint variable analysis, finds what DCE may remove
+    struct FaintAnalysis : public Dataflow<false>
     {
-        static char ID;
+        FaintAnalysis() : Dataflow<false>(), effects(NULL) {}
 
-        DCE() : Dataflow<false>(), FunctionPass(ID) {
-          index = new std::map<Value*, int>();
-          r_index = new std::vector<Value*>();
-          instIn = new ValueMap<Instruction*, BitVector*>();
-        }
+        // bit numbers of the arguments and definitions, and back
+        ValueNumbering numbering;
 
-        // Map from instructions/argument to their index in the bitvector
-        std::map<Value*, int> *index;
-        
-        // Map from index in bitvector back to instruction/argument
-        std::vector<Value*> *r_index;
+        // which calls can go, NULL to keep them all
+        const SideEffects *effects;
+
+        // by id: allocas whose address escapes, stores to them are never faint
+        std::vector<bool> escapes;
         
         // convenience
         int numTotal;
         int numArgs;
 
-        // map from instructions to bitvector corresponding to program point BEFORE that instruction
-        ValueMap<Instruction*, BitVector*> *instIn;
-
-        virtual void meet(BitVector *op1, const BitVector *op2) {
+        virtual void meet(Set op1, Set op2) {
           // intersection
-          *op1 &= *op2;
+          op1 &= op2;
         }
 
-        virtual void getBoundaryCondition(BitVector *entry) {
+        virtual MeetOp meetOp() { return MEET_INTERSECTION; }
+
+        virtual void getBoundaryCondition(Set entry) {
           // out[b] = start with everything faint 
-          *entry = BitVector(numTotal, true);
+          entry.set();
         }
         
 
@@ -63,25 +70,40 @@ namespace
           return (!ii->getType()->isVoidTy());
         }
 
-        // Terminators and Calls can never be removed from the function due to possible side effects
+        // Terminators and Calls with possible side effects can never be removed from the function
         // Stores can sometimes be removed, but they form a special case in the function Eliminate
         bool isEliminableDef(Instruction *ii) {
-          return (!(isa<TerminatorInst>(ii) || isa<StoreInst>(ii) || isa<CallInst>(ii)));
+          return (!(isa<TerminatorInst>(ii) || isa<StoreInst>(ii) || (isa<CallInst>(ii) && !isRemovableCall(ii))));
+        }
+
+        // A call that neither writes memory nor unwinds is only there for its result
+        bool isRemovableCall(Instruction *ii) {
+          CallInst *CI = dyn_cast<CallInst>(ii);
+          return CI && effects && effects->removable(CI);
         }
 
-        BitVector* initialInteriorPoint(BasicBlock& bb) {
+        void initialInteriorPoint(BasicBlock& bb, Set init) {
           // in[b] = everything is faint initially
-          return new BitVector(numTotal, true);
+          init.set();
+        }
+
+        // everything kept for the last function, after the solver's own
+        void releaseMemory() {
+          Dataflow<false>::releaseMemory();
+          numbering.clear();
+          escapes.clear();
         }
 
         virtual bool runOnFunction(Function &F) {
+          double start = wallTime();
+          traceBegin("index", F);
           numTotal = 0;
           numArgs = 0;
+          numbering.clear();
           
           // Add function arguments to maps
           for (Function::arg_iterator ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++) {
-            (*index)[&*ai] = numArgs;
-            r_index->push_back(&*ai);
+            numbering.add(&*ai);
             numArgs++;
           }
           numTotal = numArgs; 
@@ -90,121 +112,436 @@ namespace
           // Add definitions to maps
           for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
             if (isDefinition(&*ii)) {
-              (*index)[&*ii] = numTotal;
-              r_index->push_back(&*ii);
+              numbering.add(&*ii);
               numTotal++;
             }
           }
-          
-          // Initialize instIn
-          for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++) {
-            (*instIn)[&*ii] = new BitVector(numTotal, true); //TODO true orfalse
+          numbering.index(F);
+
+          escapes.assign(numTotal, false);
+          for (int id = numArgs; id < numTotal; id++) {
+            if (AllocaInst *A = dyn_cast<AllocaInst>(numbering.value(id)))
+              escapes[id] = addressEscapes(A);
           }
-          top = new BitVector(numTotal, true);
+          
+          width = numTotal;
+          sccThreads = DCESCC;
           
           // Run data flow 
+          double indexTime = wallTime() - start;
+          traceEnd("index", F);
           Dataflow<false>::runOnFunction(F);
-
-          // Eliminate returns true if any instruction was removed
-          return Eliminate(F);
+          stats.time[PHASE_INDEX] = indexTime;
+          return false;
         }
         
-        virtual BitVector* transfer(BasicBlock& bb) {
-          // We iterate over instructions in reverse beginning with out[bb]
-          BitVector* next = new BitVector(*((*out)[&bb]));
-          
-          // Temporary variables for convenience
-          BitVector* instVec = next; // for empty blocks
-          Instruction* inst;
-
-
-          // Go through instructions in reverse
-          BasicBlock::iterator ii = --(bb.end()), ib = bb.begin();
-          while (true) {
-            
-            // Inherit data from next instruction
-            inst = &*ii;
-            instVec = (*instIn)[inst];            
-            *instVec = *next;
-            
-            if (!isa<StoreInst>(inst) && (isa<CallInst>(inst)|| isa<TerminatorInst>(inst) 
-                || (!(*instVec)[(*index)[inst]]))) {
-              // This instruction is either a call, terminator, or some instruction with a non-faint LHS
-              // In this case, we must mark all variables used in the instruction as non-faint
-              // For function calls, the arguments to the function are not faint (and the function call cannot be eliminated) even if its return value is never used because the function might have side effects.
-              User::op_iterator OI, OE;
-              for (OI = inst->op_begin(), OE=inst->op_end(); OI != OE; ++OI) {
-                if (isa<Instruction>(*OI) || isa<Argument>(*OI)) {
-                  (*instVec)[(*index)[*OI]] = false;
-                }
-              }
-            } else if (isa<StoreInst>(inst)) {
-              // For stores, mark stored value as not-faint iff the destination of a store is locally allocated and not-faint, OR if it is a global/argument
-              // In case of stores to a global/argument, the stored value can never be faint since it may be used outside the function.
-              StoreInst* si = cast<StoreInst>(inst);
-              Value * addr = si->getPointerOperand();
-
-              if (isa<AllocaInst>(addr) && !(*instVec)[(*index)[addr]]) {
-                Value * val = si->getValueOperand();
-                if (isa<Instruction>(val) || isa<Argument>(val))
-                  (*instVec)[(*index)[val]] = false;
+        // keeps the numbering in step with the changes update() is told of
+        virtual void blockChanged(BasicBlock &bb) { numbering.reindex(&bb); }
+        virtual void erasing(Instruction &I) { numbering.erase(&I); }
+
+        // Turns the set after inst into the set before it
+        virtual void transferInstruction(Instruction& inst, Set instVec) {
+          transferAt(numbering.position(&inst), instVec);
+        }
+
+        // walks over a block go by position
+        virtual const ValueNumbering *instructionNumbering() { return &numbering; }
+
+        // transferInstruction for the instruction at position p, without a lookup
+        virtual void transferAt(unsigned p, Set instVec) {
+          Instruction &inst = *numbering.insts[p];
+          unsigned def = numbering.instIds[p];
+          bool removable = isRemovableCall(&inst);
+          if (!isa<StoreInst>(inst) && ((isa<CallInst>(inst) && !removable) || isa<TerminatorInst>(inst)
+              || (def == ValueNumbering::NONE ? !removable : !instVec[def]))) {
+            // This instruction is either a call, terminator, or some instruction with a non-faint LHS
+            // In this case, we must mark all variables used in the instruction as non-faint
+            // For function calls, the arguments to the function are not faint (and the function call cannot be eliminated) even if its return value is never used because the function might have side effects.
+            // Calls without side effects are like any other definition: their arguments are faint if their result is.
+            for (const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p); op != oe; ++op) {
+              if (*op != ValueNumbering::NONE) {
+                instVec.reset(*op);
               }
             }
-            next = instVec;
+          } else if (isa<StoreInst>(inst)) {
+            // For stores, mark stored value as not-faint iff the destination of a store is locally allocated and not-faint, OR if it is a global/argument
+            // In case of stores to a global/argument, the stored value can never be faint since it may be used outside the function.
+            // The same goes for an alloca whose address escapes, it may be read through another pointer.
+            // The operands of a store are the value, then the address.
+            StoreInst* si = cast<StoreInst>(&inst);
+            const unsigned *ops = numbering.opBegin(p);
+            bool local = isa<AllocaInst>(si->getPointerOperand()) && !escapes[ops[1]];
 
-            if (ii == ib) break;
-            --ii;
+            if (!local || !instVec[ops[1]]) {
+              if (ops[0] != ValueNumbering::NONE)
+                instVec.reset(ops[0]);
+            }
+            // Such a store stays, so the address it computes is needed as well
+            if (!local && ops[1] != ValueNumbering::NONE)
+              instVec.reset(ops[1]);
           }
-          
-          instVec = new BitVector(*instVec);
-          return instVec;
         }
 
-        // Dead Code Elimination. Removes all instructions that create/store to faint variables
+        // the whole block bottom to top, by position
+        virtual bool transfer(BasicBlock& bb, Set cur) {
+          cur.copy((*out)[&bb]);
+          std::pair<unsigned, unsigned> range = numbering.block(&bb);
+          for (unsigned p = range.second; p-- > range.first; ) {
+            transferAt(p, cur);
+          }
+          return (*in)[&bb].assign(cur);
+        }
+
+        // Collects all instructions that create/store to faint variables, in program order
         // Do not remove:
-        // - Function Calls
+        // - Function Calls that may have side effects
         // - Stores to global variables or arguments
         // Such instructions cannot be removed as they might have side effects
-        virtual bool Eliminate(Function &F) {
-          //did we actually change anything? LLVM needs this info
-          bool modified = false; 
-
+        // Faintness is read just after each instruction rather than at the
+        // entry, so code the entry never reaches is judged by its own uses too
+        void findDead(Function &F, std::vector<Instruction*> &dead) {
           //assumes the FVA analysis has already been completed
-          BitVector *faint = (*in)[&(F.getEntryBlock())];
-
-          //Iterate over all instructions in the function, and remove ones that define faint variables
-          inst_iterator ii = inst_begin(F);
-
-          while (ii != inst_end(F)) {
-            if (isEliminableDef(&*ii) && ((*faint)[(*index)[&*ii]])) {
-              // Instruction is not a function call, terminator or store
-              inst_iterator j = ii;
-              ++ii;
-              j->eraseFromParent();
-              modified = true;
+          for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ++ii) {
+            if (isEliminableDef(&*ii)) {
+              // Instruction is not a function call with side effects, terminator or store
+              // A removable call with no result is never needed
+              unsigned id = numbering.lookup(&*ii);
+              if (id == ValueNumbering::NONE ? isRemovableCall(&*ii) : setAfter(&*ii)[id])
+                dead.push_back(&*ii);
             } else if (isa<StoreInst>(&*ii)) {
               Value * addr = cast<StoreInst>(&*ii)->getPointerOperand();
-              if (isa<AllocaInst>(addr) && (*faint)[(*index)[addr]]) {
-                //make sure store is to a variable allocated within this function
-                inst_iterator j = ii;
-                ++ii;
-                j->eraseFromParent();
-                modified = true;
-              } else {
-                //Do not remove stores to a global variable or arguments
-                ++ii;
-              }
+              //make sure store is to a variable allocated within this function
+              //Do not remove stores to a global variable or arguments, or to one whose address escapes
+              if (!isa<AllocaInst>(addr)) continue;
+              unsigned id = numbering.lookup(addr);
+              if (!escapes[id] && setAfter(&*ii)[id])
+                dead.push_back(&*ii);
+            }
+            //Do not remove function calls/terminators.
+          }
+        }
+
+        // FVA keeps every branch
+        void findDeadBranches(std::vector<DeadBranch> &) {}
+    };
+
+    /* Dead Code Elimination. Removes what findDead collected, returns true
+     * if anything was removed. Dead instructions use each other in any
+     * order, so first every one lets go of its operands, and only then are
+     * they deleted: none has a use left by the time it goes, and no use
+     * list is updated twice. */
+    static bool Eliminate(std::vector<Instruction*> &dead) {
+      for (unsigned i = 0; i < dead.size(); i++) {
+        dead[i]->dropAllReferences();
+      }
+      for (unsigned i = 0; i < dead.size(); i++) {
+        // only code the entry never reaches, or a dead branch, can still use it
+        if (!dead[i]->use_empty())
+          dead[i]->replaceAllUsesWith(UndefValue::get(dead[i]->getType()));
+        dead[i]->eraseFromParent();
+      }
+      return !dead.empty();
+    }
+
+    // blocks the entry can get to
+    static void reachableBlocks(Function &F, SmallPtrSet<BasicBlock*, 32> &reached) {
+      std::vector<BasicBlock*> stack(1, &F.getEntryBlock());
+      reached.insert(&F.getEntryBlock());
+      while (!stack.empty()) {
+        BasicBlock *bb = stack.back();
+        stack.pop_back();
+        for (succ_iterator SI = succ_begin(bb), SE = succ_end(bb); SI != SE; ++SI) {
+          if (reached.count(*SI)) continue;
+          reached.insert(*SI);
+          stack.push_back(*SI);
+        }
+      }
+    }
+
+    /* Turns each dead branch into a jump to the successor chosen for it,
+     * then deletes the blocks that leaves unreachable, which is where the
+     * dead loops and arms of ifs go, and folds away blocks in touched that
+     * are left with nothing but a jump or with a lone predecessor that
+     * jumps straight to them. Returns true if there were any branches. */
+    static bool RemoveDeadBranches(Function &F, std::vector<DeadBranch> &branches,
+                                   std::vector<BasicBlock*> &touched) {
+      if (branches.empty()) return false;
+      for (unsigned i = 0; i < branches.size(); i++) {
+        TerminatorInst *T = branches[i].first;
+        BasicBlock *bb = T->getParent(), *target = branches[i].second;
+        bool kept = false;
+        for (unsigned s = 0, n = T->getNumSuccessors(); s < n; s++) {
+          // one edge to target stays, the phis there have their entry for it
+          if (T->getSuccessor(s) == target && !kept) kept = true;
+          else T->getSuccessor(s)->removePredecessor(bb);
+        }
+        BranchInst::Create(target, T);
+        T->eraseFromParent();
+        touched.push_back(bb);
+      }
+
+      // as in Eliminate: let go of everything first, then delete
+      SmallPtrSet<BasicBlock*, 32> reached;
+      reachableBlocks(F, reached);
+      std::vector<BasicBlock*> gone;
+      for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+        if (!reached.count(&*bb)) gone.push_back(&*bb);
+      }
+      for (unsigned i = 0; i < gone.size(); i++) {
+        for (succ_iterator SI = succ_begin(gone[i]), SE = succ_end(gone[i]); SI != SE; ++SI) {
+          if (reached.count(*SI)) (*SI)->removePredecessor(gone[i]);
+        }
+      }
+      for (unsigned i = 0; i < gone.size(); i++) {
+        gone[i]->dropAllReferences();
+      }
+      for (unsigned i = 0; i < gone.size(); i++) {
+        for (BasicBlock::iterator ii = gone[i]->begin(), ie = gone[i]->end(); ii != ie; ++ii) {
+          if (!ii->use_empty()) ii->replaceAllUsesWith(UndefValue::get(ii->getType()));
+        }
+        gone[i]->eraseFromParent();
+      }
+
+      // in the function's block order, so the output does not depend on where the blocks are in memory
+      SmallPtrSet<BasicBlock*, 32> pending;
+      for (unsigned i = 0; i < touched.size(); i++) {
+        if (!pending.count(touched[i])) pending.insert(touched[i]);
+      }
+      touched.clear();
+      for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+        if (pending.count(&*bb)) touched.push_back(&*bb);
+      }
+      for (unsigned i = 0; i < touched.size(); i++) {
+        BasicBlock *bb = touched[i];
+        if (bb == &F.getEntryBlock()) continue;
+        BranchInst *br = dyn_cast<BranchInst>(&bb->front());
+        if (br && br->isUnconditional() && br->getSuccessor(0) != bb && TryToSimplifyUncondBranchFromEmptyBlock(bb))
+          continue;
+        // or what is left of it joins the block before, if that only leads here
+        MergeBlockIntoPredecessor(bb);
+      }
+      return true;
+    }
+
+    // what one round found: the dead instructions, then the dead branches
+    static bool EliminateAll(Function &F, std::vector<Instruction*> &dead, std::vector<DeadBranch> &branches,
+                             std::vector<BasicBlock*> &touched) {
+      touched.clear();
+      for (unsigned i = 0; i < dead.size(); i++) {
+        touched.push_back(dead[i]->getParent());
+      }
+      bool modified = Eliminate(dead);
+      return RemoveDeadBranches(F, branches, touched) || modified;
+    }
+
+    // what the options ask of an analysis; -dce-aggressive only changes the marking
+    static void configure(FaintAnalysis &faint, const SideEffects &effects) { faint.effects = &effects; }
+    static void configure(MarkSweep &sweep, const SideEffects &effects) {
+      sweep.aggressive = DCEAggressive;
+      sweep.effects = &effects;
+    }
+
+    static cl::opt<std::string> DCEStats("dce-stats",
+        cl::desc("Write per-function solver counters of -DCE to this file: CSV if it ends in .csv, JSON otherwise, - for stderr"));
+
+    static cl::opt<std::string> DCETrace("dce-trace",
+        cl::desc("Write a timeline of -DCE phases to this file at exit, in trace event JSON"));
+
+    static cl::opt<bool> DCEFaint("dce-faint",
+        cl::desc("Find dead code with the faint variable analysis over every value, rather than by marking from what has to stay"));
+
+    static cl::opt<bool> DCESummarize("dce-summarize",
+        cl::desc("Also remove unused calls to functions of the module found to have no side effects, callees first over the call graph"));
+
+    static cl::opt<unsigned> DCEThreads("dce-threads",
+        cl::desc("Threads for -DCEParallel, 0 for one per core"), cl::init(0));
+
+    struct DCE : public FunctionPass
+    {
+        static char ID;
+
+        DCE() : FunctionPass(ID) {}
+
+        FaintAnalysis faint;
+        MarkSweep sweep;
+        SideEffects effects;
+        std::vector<SolverStats> allStats;
+
+        virtual bool doInitialization(Module &M) {
+          effects.clear();
+          if (DCESummarize) effects.summarize(M);
+          return false;
+        }
+
+        virtual bool runOnFunction(Function &F) {
+          if (!DCETrace.empty()) startTrace(DCETrace);
+          return DCEFaint ? runFaint(F) : runSweep(F);
+        }
+
+        bool runFaint(Function &F) {
+          configure(faint, effects);
+          faint.runOnFunction(F);
+
+          /* Removing code can leave more behind it dead, so go again until
+           * a round finds nothing. The analysis is told what went and only
+           * solves the blocks that flow into those again. */
+          double start = wallTime();
+          traceBegin("eliminate", F);
+          std::vector<Instruction*> dead;
+          bool modified = false;
+          for (;;) {
+            dead.clear();
+            faint.findDead(F, dead);
+            if (dead.empty()) break;
+            for (unsigned i = 0; i < dead.size(); i++) {
+              // users the entry never reaches get undef in its place
+              faint.usesReplaced(dead[i], UndefValue::get(dead[i]->getType()));
+              faint.instructionErased(dead[i]);
+            }
+            modified |= Eliminate(dead);
+            faint.update();
+          }
+          faint.stats.time[PHASE_OUTPUT] = wallTime() - start;
+          traceEnd("eliminate", F);
+
+          if (!DCEStats.empty()) allStats.push_back(faint.stats);
+          return modified;
+        }
+
+        // the same rounds, marking afresh each time since that takes one pass
+        bool runSweep(Function &F) {
+          SolverStats stats;
+          std::vector<Instruction*> dead;
+          std::vector<DeadBranch> branches;
+          std::vector<BasicBlock*> touched;
+          bool modified = false;
+          for (unsigned round = 0; ; round++) {
+            configure(sweep, effects);
+            sweep.runOnFunction(F);
+            if (round == 0) {
+              stats = sweep.stats;
             } else {
-              //Do not remove function calls/terminators.
-              ++ii;
+              stats.time[PHASE_INDEX] += sweep.stats.time[PHASE_INDEX];
+              stats.time[PHASE_ORDER] += sweep.stats.time[PHASE_ORDER];
+              stats.time[PHASE_SOLVE] += sweep.stats.time[PHASE_SOLVE];
             }
+            double start = wallTime();
+            traceBegin("eliminate", F);
+            dead.clear();
+            branches.clear();
+            sweep.findDead(F, dead);
+            sweep.findDeadBranches(branches);
+            bool found = EliminateAll(F, dead, branches, touched);
+            modified |= found;
+            stats.time[PHASE_OUTPUT] += wallTime() - start;
+            traceEnd("eliminate", F);
+            if (!found) break;
           }
 
+          if (!DCEStats.empty()) allStats.push_back(stats);
+          return modified;
+        }
+
+        virtual void releaseMemory() {
+          faint.releaseMemory();
+          sweep.releaseMemory();
+        }
+
+        virtual bool doFinalization(Module &M) {
+          if (!DCEStats.empty()) writeStats(DCEStats, "dce", allStats);
+          return false;
+        }
+    };
+
+    // parallelFor body of DCEParallel: function i's dead instructions go to dead[i]
+    template<class Analysis>
+    struct DeadJob {
+      std::vector<Function*> *funcs;
+      std::vector<std::vector<Instruction*> > *dead;
+      std::vector<std::vector<DeadBranch> > *branches;
+      std::vector<SolverStats> *stats;
+      std::vector<Analysis*> *analyses;
+
+      void operator()(unsigned i, unsigned w) {
+        Analysis *a = (*analyses)[w];
+        a->runOnFunction(*(*funcs)[i]);
+        a->findDead(*(*funcs)[i], (*dead)[i]);
+        a->findDeadBranches((*branches)[i]);
+        (*stats)[i] = a->stats;
+        a->releaseMemory();
+      }
+    };
+
+    /* DCE for a whole module. The analysis runs on a pool of threads; the
+     * instructions are removed afterwards on this one, in module order,
+     * since erasing touches use lists that functions share (constants,
+     * globals). */
+    struct DCEParallel : public ModulePass
+    {
+        static char ID;
+
+        DCEParallel() : ModulePass(ID) {}
+
+        SideEffects effects;
+
+        virtual bool runOnModule(Module &M) {
+          if (!DCETrace.empty()) startTrace(DCETrace);
+          effects.clear();
+          if (DCESummarize) effects.summarize(M);
+          return DCEFaint ? eliminateAll<FaintAnalysis>(M) : eliminateAll<MarkSweep>(M);
+        }
+
+        template<class Analysis>
+        bool eliminateAll(Module &M) {
+          std::vector<Function*> funcs;
+          definedFunctions(M, funcs);
+          unsigned threads = std::min(workerCount(DCEThreads), (unsigned)funcs.size());
+
+          std::vector<Analysis*> analyses;
+          for (unsigned w = 0; w < threads; w++) {
+            analyses.push_back(new Analysis());
+            configure(*analyses.back(), effects);
+          }
+
+          /* Rounds as in DCE, but the analyses don't outlive a round, so a
+           * function that lost something is analyzed afresh in the next one.
+           * Functions that lost nothing are done. */
+          std::vector<SolverStats> allStats;
+          bool modified = false;
+          while (!funcs.empty()) {
+            std::vector<std::vector<Instruction*> > dead(funcs.size());
+            std::vector<std::vector<DeadBranch> > branches(funcs.size());
+            std::vector<SolverStats> stats(funcs.size());
+            DeadJob<Analysis> job = { &funcs, &dead, &branches, &stats, &analyses };
+            parallelFor(funcs.size(), threads, job);
+
+            std::vector<Function*> changed;
+            std::vector<BasicBlock*> touched;
+            for (unsigned i = 0; i < funcs.size(); i++) {
+              double start = wallTime();
+              traceBegin("eliminate", *funcs[i]);
+              if (EliminateAll(*funcs[i], dead[i], branches[i], touched)) {
+                modified = true;
+                changed.push_back(funcs[i]);
+              }
+              stats[i].time[PHASE_OUTPUT] = wallTime() - start;
+              traceEnd("eliminate", *funcs[i]);
+            }
+            allStats.insert(allStats.end(), stats.begin(), stats.end());
+            funcs.swap(changed);
+          }
+          if (!DCEStats.empty()) writeStats(DCEStats, "dce", allStats);
+          for (unsigned w = 0; w < threads; w++) {
+            delete analyses[w];
+          }
           return modified;
         }
     };
 
     char DCE::ID = 0;
     static RegisterPass<DCE> x("DCE", "DCE", false, false);
+
+    char DCEParallel::ID = 0;
+    static RegisterPass<DCEParallel> y("DCEParallel", "DCE on all functions at once", false, false);
 }
 
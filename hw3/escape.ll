@@ -0,0 +1,86 @@
+; Stores to locals whose address escapes, read back through another pointer.
+; -DCE has to keep every one of them: main returns 0 before and after.
+;   llvm-as escape.ll -o escape.o
+;   opt -load llvm/Debug+Asserts/lib/DCE.so -DCE escape.o | lli
+
+@keep = internal global i32* null
+
+define internal void @save(i32* %p) nounwind {
+entry:
+  store i32* %p, i32** @keep
+  ret void
+}
+
+; int x; int *p = &x; x = 5; return *p;
+define internal i32 @direct() nounwind {
+entry:
+  %x = alloca i32
+  %p = alloca i32*
+  store i32* %x, i32** %p
+  store i32 5, i32* %x
+  %0 = load i32** %p
+  %1 = load i32* %0
+  ret i32 %1
+}
+
+; int x; char *c = (char *) &x; x = 7; return *(int *) c;
+define internal i32 @cast() nounwind {
+entry:
+  %x = alloca i32
+  %c = bitcast i32* %x to i8*
+  store i32 7, i32* %x
+  %0 = bitcast i8* %c to i32*
+  %1 = load i32* %0
+  ret i32 %1
+}
+
+; int a[2]; int *e = &a[1]; *(long *) a = 9L << 32; return *e;
+define internal i32 @element() nounwind {
+entry:
+  %a = alloca [2 x i32]
+  %e = getelementptr [2 x i32]* %a, i32 0, i32 1
+  %0 = bitcast [2 x i32]* %a to i64*
+  store i64 38654705664, i64* %0
+  %1 = load i32* %e
+  ret i32 %1
+}
+
+; int x; save(&x); x = 3; return *keep;
+define internal i32 @callee() nounwind {
+entry:
+  %x = alloca i32
+  call void @save(i32* %x)
+  store i32 3, i32* %x
+  %0 = load i32** @keep
+  %1 = load i32* %0
+  ret i32 %1
+}
+
+; the same as direct, but with nothing reading x after: both stores go
+define internal i32 @private() nounwind {
+entry:
+  %x = alloca i32
+  store i32 5, i32* %x
+  store i32 6, i32* %x
+  ret i32 0
+}
+
+define i32 @main() nounwind {
+entry:
+  %0 = call i32 @direct()
+  %1 = call i32 @cast()
+  %2 = call i32 @element()
+  %3 = call i32 @callee()
+  %4 = call i32 @private()
+  %5 = icmp ne i32 %0, 5
+  %6 = icmp ne i32 %1, 7
+  %7 = icmp ne i32 %2, 9
+  %8 = icmp ne i32 %3, 3
+  %9 = icmp ne i32 %4, 0
+  %10 = or i1 %5, %6
+  %11 = or i1 %10, %7
+  %12 = or i1 %11, %8
+  %13 = or i1 %12, %9
+  %14 = zext i1 %13 to i32
+  ret i32 %14
+}
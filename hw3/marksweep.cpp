@@ -0,0 +1,549 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+
+#include "llvm/Function.h"
+#include "llvm/BasicBlock.h"
+#include "llvm/Instructions.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CFG.h"
+
+#include "dataflow.cpp"
+#include "purity.cpp"
+
+#include <vector>
+#include <algorithm>
+
+using namespace llvm;
+
+namespace
+{
+    /* true if the address of alloca A goes anywhere but to the loads and
+     * stores through it: to another pointer, a cast or GEP, a call. A load
+     * from there reads what was stored to A without naming A, so every
+     * store to A has to stay. */
+    static bool addressEscapes(AllocaInst *A) {
+      for (Value::use_iterator UI = A->use_begin(), UE = A->use_end(); UI != UE; ++UI) {
+        if (isa<LoadInst>(*UI)) continue;
+        StoreInst *si = dyn_cast<StoreInst>(*UI);
+        if (si && si->getOperand(0) != A) continue;
+        return true;
+      }
+      return false;
+    }
+
+    /* What the faint variable analysis finds, without a fixed point. An
+     * instruction is needed if something that has to stay (a call, a
+     * terminator, a store that is not to an alloca) uses it, or something
+     * needed does, and that use can be reached from the instruction: so
+     * marking from those roots and following operands, once per
+     * instruction, finds everything FaintAnalysis keeps. Where the function
+     * is reachable from the entry a use is always reachable from its
+     * definition, which dominates it; only in unreachable code does that
+     * take a walk.
+     *
+     * Stores to an alloca are the one thing that depends on where they are:
+     * one is needed if a needed use of the alloca can be reached from it.
+     * For those each alloca slot keeps a bit per block, set once the
+     * bottom of the block leads to such a use, and the marks walk backwards
+     * from each needed use until they meet bits already set. An alloca
+     * whose address escapes can be used without being named, so stores to
+     * it are roots like those to a global.
+     *
+     * With aggressive set, branches and switches are not kept for their own
+     * sake either. A block with something needed in it needs the branches
+     * it is control dependent on, those that decide whether it runs, and a
+     * needed phi needs the branches into it; any other branch can go
+     * straight on towards the exit (findDeadBranches), which takes loops
+     * and ifs whose results go unused with it. A loop whose results go
+     * unused is taken to end, as -adce does with loops; one that has no
+     * way out at all keeps its branches. */
+    // a branch nothing needs, and the successor it is to jump to instead
+    typedef std::pair<TerminatorInst*, BasicBlock*> DeadBranch;
+
+    struct MarkSweep {
+      MarkSweep() : aggressive(false), effects(NULL), stamp(0) {}
+
+      bool aggressive;
+
+      // which calls can go, NULL to keep them all
+      const SideEffects *effects;
+
+      enum { NONE = ~0u };
+
+      // ids and positions as FaintAnalysis has them
+      ValueNumbering numbering;
+
+      // blocks by number, and back
+      std::vector<BasicBlock*> blocks;
+      DenseMap<BasicBlock*, unsigned> number;
+
+      // predecessors of block b: preds[predStart[b]] .. preds[predStart[b+1]-1], likewise successors
+      std::vector<unsigned> preds, predStart, succs, succStart;
+
+      // blocks reachable from the entry
+      std::vector<bool> reachable;
+
+      // the block of each position, and the position of each id (NONE for arguments)
+      std::vector<unsigned> blockOf, idPos;
+
+      // the position of the terminator of each block
+      std::vector<unsigned> lastPos;
+
+      /* For aggressive: the immediate post-dominator of each block, where
+       * blocks.size() stands for a single exit after every return and after
+       * every block that cannot get to one, and the edges from each block
+       * to a return (NONE if there is no way). */
+      std::vector<unsigned> ipdom, exitDistance;
+
+      // blocks that block b is control dependent on: controls[controlStart[b]] .. controls[controlStart[b+1]-1]
+      std::vector<unsigned> controls, controlStart;
+
+      // blocks with something needed in them
+      std::vector<bool> liveBlock;
+
+      // by id: allocas whose address escapes
+      std::vector<bool> escapes;
+
+      // the slot of each id, NONE unless it is an alloca with stores to it
+      std::vector<unsigned> slotOf;
+
+      // stores to an alloca, sorted by slot, block and position
+      struct SlotStore {
+        unsigned slot, block, pos;
+        bool operator<(const SlotStore &o) const {
+          if (slot != o.slot) return slot < o.slot;
+          if (block != o.block) return block < o.block;
+          return pos < o.pos;
+        }
+      };
+      std::vector<SlotStore> slotStores;
+
+      // bit b of slotOut[s] is set once the bottom of block b leads to a needed use of slot s
+      std::vector<BitVector> slotOut;
+
+      // by position: what the marking found needed
+      std::vector<bool> live;
+      std::vector<unsigned> worklist, stack;
+
+      // marks for reaches(): block b is seen if seen[b] == stamp
+      std::vector<unsigned> seen;
+      unsigned stamp;
+
+      SolverStats stats;
+
+      /* Marks everything in F that has to stay. F is numbered afresh, so
+       * it can be called again after code has been deleted. */
+      void runOnFunction(Function &F) {
+        releaseMemory();
+        stats.clear();
+        stats.function = F.getName().str();
+        stats.storage = "marks";
+        double start = wallTime();
+        traceBegin("index", F);
+        index(F);
+        stats.time[PHASE_INDEX] = wallTime() - start;
+        traceEnd("index", F);
+
+        if (aggressive) {
+          start = wallTime();
+          traceBegin("order", F);
+          computeControlDependence();
+          stats.time[PHASE_ORDER] = wallTime() - start;
+          traceEnd("order", F);
+        }
+
+        start = wallTime();
+        traceBegin("solve", F);
+        unsigned n = numbering.insts.size();
+        live.assign(n, false);
+        for (unsigned p = 0; p < n; p++) {
+          if (isRoot(p)) mark(p);
+        }
+        while (!worklist.empty()) {
+          unsigned p = worklist.back();
+          worklist.pop_back();
+          stats.pops++;
+          useOperands(p);
+        }
+        for (unsigned s = 0; s < slotOut.size(); s++) {
+          stats.setBytes += (slotOut[s].size() + 7) / 8;
+        }
+        stats.time[PHASE_SOLVE] = wallTime() - start;
+        traceEnd("solve", F);
+      }
+
+      void releaseMemory() {
+        numbering.clear();
+        blocks.clear();
+        number.clear();
+        trim(preds); trim(predStart);
+        trim(succs); trim(succStart);
+        reachable.clear();
+        trim(blockOf); trim(idPos); trim(slotOf);
+        escapes.clear();
+        trim(lastPos);
+        trim(ipdom); trim(exitDistance);
+        trim(controls); trim(controlStart);
+        liveBlock.clear();
+        trim(slotStores);
+        slotOut.clear();
+        live.clear();
+        trim(seen);
+        stamp = 0;
+      }
+
+      /* Collects what FaintAnalysis::findDead would, in program order:
+       * definitions nothing needs, and stores to an alloca that no needed
+       * use follows. */
+      void findDead(Function &F, std::vector<Instruction*> &dead) {
+        for (unsigned p = 0, n = numbering.insts.size(); p < n; p++) {
+          if (!live[p] && !isa<TerminatorInst>(numbering.insts[p])) dead.push_back(numbering.insts[p]);
+        }
+      }
+
+      /* The branches and switches nothing needs, if aggressive, each with
+       * the successor to jump to instead: the one nearest a return. Nothing
+       * needed lies between a dead branch and where its successors meet
+       * again, and every dead branch on the way is turned the same way, so
+       * each step gets closer to a return. */
+      void findDeadBranches(std::vector<DeadBranch> &branches) {
+        if (!aggressive) return;
+        for (unsigned b = 0, nb = blocks.size(); b < nb; b++) {
+          TerminatorInst *T = cast<TerminatorInst>(numbering.insts[lastPos[b]]);
+          if (live[lastPos[b]] || T->getNumSuccessors() < 2) continue;
+          unsigned best = succs[succStart[b]];
+          for (unsigned e = succStart[b] + 1; e < succStart[b + 1]; e++) {
+            if (exitDistance[succs[e]] < exitDistance[best]) best = succs[e];
+          }
+          branches.push_back(DeadBranch(T, blocks[best]));
+        }
+      }
+
+      void index(Function &F) {
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          number[&*bb] = blocks.size();
+          blocks.push_back(&*bb);
+        }
+        unsigned nb = blocks.size();
+        for (unsigned b = 0; b < nb; b++) {
+          predStart.push_back(preds.size());
+          for (pred_iterator PI = pred_begin(blocks[b]), PE = pred_end(blocks[b]); PI != PE; ++PI) {
+            preds.push_back(number[*PI]);
+          }
+          succStart.push_back(succs.size());
+          for (succ_iterator SI = succ_begin(blocks[b]), SE = succ_end(blocks[b]); SI != SE; ++SI) {
+            succs.push_back(number[*SI]);
+          }
+        }
+        predStart.push_back(preds.size());
+        succStart.push_back(succs.size());
+
+        reachable.assign(nb, false);
+        if (nb) {
+          reachable[0] = true;
+          stack.push_back(0);
+        }
+        while (!stack.empty()) {
+          unsigned b = stack.back();
+          stack.pop_back();
+          for (unsigned e = succStart[b]; e < succStart[b + 1]; e++) {
+            if (!reachable[succs[e]]) {
+              reachable[succs[e]] = true;
+              stack.push_back(succs[e]);
+            }
+          }
+        }
+
+        // the same ids as FaintAnalysis: arguments, then every definition
+        for (Function::arg_iterator ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ++ai) {
+          numbering.add(&*ai);
+        }
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+            if (!ii->getType()->isVoidTy()) numbering.add(&*ii);
+          }
+        }
+        numbering.index(F);
+
+        // index() lays the blocks out in function order
+        unsigned n = numbering.insts.size();
+        blockOf.resize(n);
+        lastPos.resize(nb);
+        for (unsigned b = 0; b < nb; b++) {
+          std::pair<unsigned, unsigned> range = numbering.block(blocks[b]);
+          std::fill(blockOf.begin() + range.first, blockOf.begin() + range.second, b);
+          lastPos[b] = range.second - 1;
+        }
+        idPos.assign(numbering.size(), (unsigned)NONE);
+        for (unsigned p = 0; p < n; p++) {
+          if (numbering.instIds[p] != ValueNumbering::NONE) idPos[numbering.instIds[p]] = p;
+        }
+
+        escapes.assign(numbering.size(), false);
+        for (unsigned p = 0; p < n; p++) {
+          if (AllocaInst *A = dyn_cast<AllocaInst>(numbering.insts[p]))
+            escapes[numbering.instIds[p]] = addressEscapes(A);
+        }
+
+        slotOf.assign(numbering.size(), (unsigned)NONE);
+        for (unsigned p = 0; p < n; p++) {
+          if (!isLocalStore(p)) continue;
+          unsigned addr = numbering.opBegin(p)[1];
+          if (slotOf[addr] == NONE) {
+            slotOf[addr] = slotOut.size();
+            slotOut.push_back(BitVector(nb));
+          }
+          SlotStore s = { slotOf[addr], blockOf[p], p };
+          slotStores.push_back(s);
+        }
+        std::sort(slotStores.begin(), slotStores.end());
+
+        seen.assign(nb, 0);
+        stats.blocks = nb;
+        stats.values = numbering.size();
+      }
+
+      // a store whose address is an alloca that does not escape, the one kind FaintAnalysis treats by position
+      bool isLocalStore(unsigned p) const {
+        StoreInst *si = dyn_cast<StoreInst>(numbering.insts[p]);
+        return si && isa<AllocaInst>(si->getPointerOperand()) && !escapes[numbering.opBegin(p)[1]];
+      }
+
+      /* what FaintAnalysis never finds faint: calls with side effects,
+       * terminators, other stores, and anything else without a value. If
+       * aggressive, branches and switches only where there is no way to a
+       * return. */
+      bool isRoot(unsigned p) const {
+        Instruction *I = numbering.insts[p];
+        if (isa<StoreInst>(I)) return !isLocalStore(p);
+        if (aggressive && (isa<BranchInst>(I) || isa<SwitchInst>(I)))
+          return exitDistance[blockOf[p]] == NONE;
+        if (isa<TerminatorInst>(I)) return true;
+        CallInst *CI = dyn_cast<CallInst>(I);
+        if (CI && effects && effects->removable(CI)) return false;
+        return CI || numbering.instIds[p] == ValueNumbering::NONE;
+      }
+
+      void mark(unsigned p) {
+        if (live[p]) return;
+        live[p] = true;
+        stats.pushes++;
+        worklist.push_back(p);
+      }
+
+      // the operands the instruction at p needs, now that it stays
+      void useOperands(unsigned p) {
+        if (aggressive) {
+          useBlock(blockOf[p]);
+          // the phi has to know which way it was entered
+          if (PHINode *phi = dyn_cast<PHINode>(numbering.insts[p])) {
+            for (unsigned i = 0, k = phi->getNumIncomingValues(); i < k; i++) {
+              mark(lastPos[number[phi->getIncomingBlock(i)]]);
+            }
+          }
+        }
+
+        const unsigned *op = numbering.opBegin(p), *oe = numbering.opEnd(p);
+        // a store to an alloca needs the value it stores, not the alloca
+        if (isLocalStore(p)) oe = op + 1;
+        for (; op != oe; ++op) {
+          if (*op == ValueNumbering::NONE) continue;
+          unsigned d = idPos[*op];
+          if (d != NONE && !live[d] && reaches(d, p)) mark(d);
+          if (slotOf[*op] != NONE) markStores(slotOf[*op], p);
+        }
+      }
+
+      /* true if the instruction at p can be reached from just after the one
+       * at d, which it uses */
+      bool reaches(unsigned d, unsigned p) {
+        Instruction *user = numbering.insts[p];
+        if (PHINode *phi = dyn_cast<PHINode>(user)) {
+          // d dominates the end of each reachable block it comes in from
+          for (unsigned i = 0, k = phi->getNumIncomingValues(); i < k; i++) {
+            if (phi->getIncomingValue(i) == numbering.insts[d] && reachable[number[phi->getIncomingBlock(i)]])
+              return true;
+          }
+        } else if (reachable[blockOf[p]]) {
+          return true;
+        }
+
+        unsigned bd = blockOf[d], bp = blockOf[p];
+        if (bd == bp && d < p) return true;
+        if (++stamp == 0) {
+          // wrapped around, so old marks could look current
+          std::fill(seen.begin(), seen.end(), 0);
+          stamp = 1;
+        }
+        stack.clear();
+        stack.push_back(bd);
+        while (!stack.empty()) {
+          unsigned b = stack.back();
+          stack.pop_back();
+          for (unsigned e = succStart[b]; e < succStart[b + 1]; e++) {
+            unsigned s = succs[e];
+            if (s == bp) {
+              stack.clear();
+              return true;
+            }
+            if (seen[s] == stamp) continue;
+            seen[s] = stamp;
+            stack.push_back(s);
+          }
+        }
+        return false;
+      }
+
+      /* the stores to slot s that the point just before position p can be
+       * reached from: those earlier in its block, and every one in a block
+       * whose bottom leads there */
+      void markStores(unsigned s, unsigned p) {
+        unsigned b = blockOf[p];
+        SlotStore key = { s, b, p };
+        std::vector<SlotStore>::iterator it = std::lower_bound(slotStores.begin(), slotStores.end(), key);
+        // a live store means every store to s before it in the block is too
+        while (it != slotStores.begin()) {
+          --it;
+          if (it->slot != s || it->block != b || live[it->pos]) break;
+          mark(it->pos);
+        }
+
+        stack.clear();
+        stack.push_back(b);
+        while (!stack.empty()) {
+          unsigned c = stack.back();
+          stack.pop_back();
+          for (unsigned e = predStart[c]; e < predStart[c + 1]; e++) {
+            unsigned q = preds[e];
+            if (slotOut[s].test(q)) continue;
+            slotOut[s].set(q);
+            SlotStore first = { s, q, 0 };
+            for (it = std::lower_bound(slotStores.begin(), slotStores.end(), first);
+                 it != slotStores.end() && it->slot == s && it->block == q; ++it) {
+              mark(it->pos);
+            }
+            stack.push_back(q);
+          }
+        }
+      }
+
+      // something in block b is needed, so are the branches that decide whether it runs
+      void useBlock(unsigned b) {
+        if (liveBlock[b]) return;
+        liveBlock[b] = true;
+        for (unsigned e = controlStart[b]; e < controlStart[b + 1]; e++) {
+          mark(lastPos[controls[e]]);
+        }
+      }
+
+      /* Post-dominators (Cooper, Harvey and Kennedy's iteration over the
+       * reversed CFG) and, from them, control dependence: b depends on the
+       * branch at the end of c if b post-dominates a successor of c but
+       * not c itself. */
+      void computeControlDependence() {
+        unsigned nb = blocks.size(), exit = nb;
+
+        // breadth first up from the returns
+        exitDistance.assign(nb, (unsigned)NONE);
+        std::vector<unsigned> queue;
+        for (unsigned b = 0; b < nb; b++) {
+          if (succStart[b] == succStart[b + 1]) {
+            exitDistance[b] = 0;
+            queue.push_back(b);
+          }
+        }
+        for (unsigned i = 0; i < queue.size(); i++) {
+          unsigned b = queue[i];
+          for (unsigned e = predStart[b]; e < predStart[b + 1]; e++) {
+            if (exitDistance[preds[e]] == NONE) {
+              exitDistance[preds[e]] = exitDistance[b] + 1;
+              queue.push_back(preds[e]);
+            }
+          }
+        }
+
+        // successors in the reversed CFG: the exit leads to every block that flows into it
+        std::vector<unsigned> exitSuccs;
+        for (unsigned b = 0; b < nb; b++) {
+          if (exitDistance[b] == 0 || exitDistance[b] == NONE) exitSuccs.push_back(b);
+        }
+
+        // post order of the reversed CFG from the exit
+        std::vector<unsigned> order, postNumber(nb + 1, (unsigned)NONE);
+        std::vector<std::pair<unsigned, unsigned> > dfs;
+        std::vector<bool> visited(nb + 1, false);
+        visited[exit] = true;
+        dfs.push_back(std::make_pair(exit, 0u));
+        while (!dfs.empty()) {
+          unsigned b = dfs.back().first, i = dfs.back().second++;
+          unsigned k = b == exit ? exitSuccs.size() : predStart[b + 1] - predStart[b];
+          if (i == k) {
+            postNumber[b] = order.size();
+            order.push_back(b);
+            dfs.pop_back();
+            continue;
+          }
+          unsigned s = b == exit ? exitSuccs[i] : preds[predStart[b] + i];
+          if (!visited[s]) {
+            visited[s] = true;
+            dfs.push_back(std::make_pair(s, 0u));
+          }
+        }
+
+        ipdom.assign(nb + 1, (unsigned)NONE);
+        ipdom[exit] = exit;
+        for (bool changed = true; changed; ) {
+          changed = false;
+          // reverse post order, skipping the exit at the end of order
+          for (unsigned i = order.size() - 1; i-- > 0; ) {
+            unsigned b = order[i];
+            unsigned idom = NONE;
+            if (exitDistance[b] == 0 || exitDistance[b] == NONE) idom = exit;
+            for (unsigned e = succStart[b]; e < succStart[b + 1]; e++) {
+              unsigned s = succs[e];
+              if (ipdom[s] == NONE) continue;
+              idom = idom == NONE ? s : intersect(s, idom, postNumber);
+            }
+            if (ipdom[b] != idom) {
+              ipdom[b] = idom;
+              changed = true;
+            }
+          }
+        }
+
+        // walk up from each successor of a branch to the branch's own post-dominator
+        std::vector<std::pair<unsigned, unsigned> > edges;
+        for (unsigned c = 0; c < nb; c++) {
+          if (succStart[c + 1] - succStart[c] < 2) continue;
+          for (unsigned e = succStart[c]; e < succStart[c + 1]; e++) {
+            for (unsigned r = succs[e]; r != ipdom[c] && r != exit; r = ipdom[r]) {
+              edges.push_back(std::make_pair(r, c));
+            }
+          }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        unsigned e = 0;
+        for (unsigned b = 0; b < nb; b++) {
+          controlStart.push_back(controls.size());
+          for (; e < edges.size() && edges[e].first == b; e++) {
+            controls.push_back(edges[e].second);
+          }
+        }
+        controlStart.push_back(controls.size());
+
+        liveBlock.assign(nb, false);
+      }
+
+      unsigned intersect(unsigned a, unsigned b, const std::vector<unsigned> &postNumber) const {
+        while (a != b) {
+          while (postNumber[a] < postNumber[b]) a = ipdom[a];
+          while (postNumber[b] < postNumber[a]) b = ipdom[b];
+        }
+        return a;
+      }
+    };
+}
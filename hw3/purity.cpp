@@ -0,0 +1,152 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+
+#include "llvm/Module.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <vector>
+#include <algorithm>
+
+using namespace llvm;
+
+namespace
+{
+    /* Which calls DCE may remove when nothing needs their result: those
+     * that neither write memory anyone else can see nor unwind. The call's
+     * own attributes (readnone or readonly, and nounwind) say so for any
+     * callee; summarize() also works it out for the functions a module
+     * defines, callees before callers over its call graph, so calls to
+     * helpers nobody marked up can go as well. As with readnone, a call
+     * without side effects is taken to return. */
+    struct SideEffects {
+      // functions summarize() found free of side effects, and those it found not to be
+      DenseMap<const Function*, bool> pure;
+
+      void clear() { pure.clear(); }
+
+      bool removable(CallInst *CI) const {
+        // debug info stays
+        if (isa<DbgInfoIntrinsic>(CI)) return false;
+        if (CI->onlyReadsMemory() && CI->doesNotThrow()) return true;
+        DenseMap<const Function*, bool>::const_iterator it = pure.find(CI->getCalledFunction());
+        return it != pure.end() && it->second;
+      }
+
+      /* Tarjan's algorithm over the direct calls between the functions M
+       * defines. A strongly connected component is finished only after
+       * every one it calls into, so each is decided knowing its callees:
+       * its functions are pure if nothing in them is impure, taking calls
+       * within the component to be pure. */
+      void summarize(Module &M) {
+        clear();
+        std::vector<Function*> funcs;
+        DenseMap<Function*, unsigned> number;
+        for (Module::iterator fi = M.begin(), fe = M.end(); fi != fe; ++fi) {
+          if (fi->isDeclaration()) continue;
+          number[&*fi] = funcs.size();
+          funcs.push_back(&*fi);
+        }
+
+        // callees of function f: callees[calleeStart[f]] .. callees[calleeStart[f+1]-1]
+        std::vector<unsigned> callees, calleeStart;
+        for (unsigned f = 0; f < funcs.size(); f++) {
+          calleeStart.push_back(callees.size());
+          for (Function::iterator bb = funcs[f]->begin(), be = funcs[f]->end(); bb != be; ++bb) {
+            for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+              CallInst *CI = dyn_cast<CallInst>(&*ii);
+              if (!CI) continue;
+              DenseMap<Function*, unsigned>::iterator it = number.find(CI->getCalledFunction());
+              if (it != number.end()) callees.push_back(it->second);
+            }
+          }
+        }
+        calleeStart.push_back(callees.size());
+
+        unsigned n = funcs.size();
+        const unsigned NONE = ~0u;
+        std::vector<unsigned> dfsNum(n, NONE), low(n), stack, members;
+        std::vector<bool> onStack(n, false);
+        // (function, next callee) of each level of the recursion
+        std::vector<std::pair<unsigned, unsigned> > calls;
+        unsigned counter = 0;
+
+        for (unsigned root = 0; root < n; root++) {
+          if (dfsNum[root] != NONE) continue;
+          calls.push_back(std::make_pair(root, calleeStart[root]));
+          dfsNum[root] = low[root] = counter++;
+          stack.push_back(root);
+          onStack[root] = true;
+
+          while (!calls.empty()) {
+            unsigned v = calls.back().first;
+            unsigned &e = calls.back().second;
+            if (e != calleeStart[v + 1]) {
+              unsigned w = callees[e++];
+              if (dfsNum[w] == NONE) {
+                dfsNum[w] = low[w] = counter++;
+                stack.push_back(w);
+                onStack[w] = true;
+                calls.push_back(std::make_pair(w, calleeStart[w]));
+              } else if (onStack[w]) {
+                low[v] = std::min(low[v], dfsNum[w]);
+              }
+              continue;
+            }
+
+            // all callees of v done
+            if (low[v] == dfsNum[v]) {
+              members.clear();
+              unsigned w;
+              do {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                members.push_back(w);
+                pure[funcs[w]] = true;
+              } while (w != v);
+
+              bool clean = true;
+              for (unsigned i = 0; clean && i < members.size(); i++) {
+                clean = hasNoSideEffects(*funcs[members[i]]);
+              }
+              if (!clean) {
+                for (unsigned i = 0; i < members.size(); i++) pure[funcs[members[i]]] = false;
+              }
+            }
+            calls.pop_back();
+            if (!calls.empty()) {
+              unsigned parent = calls.back().first;
+              low[parent] = std::min(low[parent], low[v]);
+            }
+          }
+        }
+      }
+
+      /* true if F writes nothing but its own allocas and cannot unwind,
+       * given what is known of its callees */
+      bool hasNoSideEffects(Function &F) const {
+        for (Function::iterator bb = F.begin(), be = F.end(); bb != be; ++bb) {
+          for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie; ++ii) {
+            Instruction *I = &*ii;
+            if (StoreInst *si = dyn_cast<StoreInst>(I)) {
+              if (si->isVolatile() || !isa<AllocaInst>(si->getPointerOperand())) return false;
+            } else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+              if (!isa<DbgInfoIntrinsic>(CI) && !removable(CI)) return false;
+            } else if (isa<TerminatorInst>(I)) {
+              if (!(isa<ReturnInst>(I) || isa<BranchInst>(I) || isa<SwitchInst>(I) || isa<UnreachableInst>(I)))
+                return false;
+            } else if (I->mayWriteToMemory()) {
+              // volatile loads among them
+              return false;
+            }
+          }
+        }
+        return true;
+      }
+    };
+}
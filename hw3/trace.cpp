@@ -0,0 +1,124 @@
+/** CMU 15-745: Optimizing Compilers
+    Spring 2011
+    Salil Joshi and Cyrus Omar
+ **/
+#include "trace.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <pthread.h>
+#include <time.h>
+
+using namespace llvm;
+
+std::string *traceFile = NULL;
+
+namespace
+{
+    struct TraceEvent {
+      // a string literal naming the phase
+      const char *name;
+      // 'B' or 'E'
+      char phase;
+      // index of the function in its buffer's functions
+      unsigned function;
+      // microseconds since startTrace
+      double ts;
+    };
+
+    // the events of one thread, never freed since they are written at exit
+    struct TraceBuffer {
+      unsigned tid;
+      std::vector<TraceEvent> events;
+      // each function's name once, so an event costs no allocation
+      std::vector<std::string> functions;
+      DenseMap<const Function*, unsigned> functionIndex;
+      TraceBuffer *next;
+
+      // F's slot in functions; a pointer reused by a later function gets a new one
+      unsigned function(const Function &F) {
+        std::pair<DenseMap<const Function*, unsigned>::iterator, bool> r =
+          functionIndex.insert(std::make_pair(&F, (unsigned) functions.size()));
+        if (!r.second && functions[r.first->second] == F.getName()) return r.first->second;
+        r.first->second = functions.size();
+        functions.push_back(F.getName().str());
+        return r.first->second;
+      }
+    };
+
+    double traceStart;
+
+    // every thread's buffer, pushed with compare-and-swap
+    TraceBuffer *traceBuffers = NULL;
+    unsigned traceThreads = 0;
+
+    pthread_key_t traceKey;
+    pthread_once_t traceKeyOnce = PTHREAD_ONCE_INIT;
+
+    void createTraceKey() { pthread_key_create(&traceKey, NULL); }
+
+    inline double traceClock() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+    }
+
+    void writeTrace() {
+      std::ofstream out(traceFile->c_str());
+      if (!out) {
+        errs() << "can't write " << *traceFile << "\n";
+        return;
+      }
+      out.setf(std::ios::fixed);
+      out.precision(3);
+      out << "{\"traceEvents\": [\n";
+      bool first = true;
+      for (TraceBuffer *b = traceBuffers; b; b = b->next) {
+        std::vector<std::string> names;
+        for (unsigned i = 0; i < b->functions.size(); i++) names.push_back(jsonEscape(b->functions[i]));
+        for (unsigned i = 0; i < b->events.size(); i++) {
+          const TraceEvent &e = b->events[i];
+          out << (first ? "" : ",\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase
+              << "\", \"ts\": " << e.ts << ", \"pid\": 1, \"tid\": " << b->tid
+              << ", \"args\": {\"function\": \"" << names[e.function] << "\"}}";
+          first = false;
+        }
+      }
+      out << "\n]}\n";
+    }
+
+    TraceBuffer *threadTraceBuffer() {
+      pthread_once(&traceKeyOnce, createTraceKey);
+      TraceBuffer *b = static_cast<TraceBuffer*>(pthread_getspecific(traceKey));
+      if (!b) {
+        b = new TraceBuffer();
+        b->tid = __sync_fetch_and_add(&traceThreads, 1);
+        do {
+          b->next = traceBuffers;
+        } while (!__sync_bool_compare_and_swap(&traceBuffers, b->next, b));
+        pthread_setspecific(traceKey, b);
+      }
+      return b;
+    }
+}
+
+void startTrace(const std::string &file) {
+  if (traceFile) return;
+  traceFile = new std::string(file);
+  traceStart = traceClock();
+  atexit(writeTrace);
+}
+
+void traceEvent(const char *name, char phase, const Function &F) {
+  TraceBuffer *b = threadTraceBuffer();
+  TraceEvent e;
+  e.name = name;
+  e.phase = phase;
+  e.function = b->function(F);
+  e.ts = traceClock() - traceStart;
+  b->events.push_back(e);
+}